@@ -13,6 +13,7 @@ the distribution).
 
 from __future__ import print_function
 import sys
+import os
 import math
 import types
 import logging
@@ -21,6 +22,7 @@ from mageckCount import *
 
 from fileOps import *
 from testVisual import *
+from rraBinding import *
 
 def getgeomean(v):
   meanval=sum([math.log(vx+0.1,2) for vx in v])/float(len(v));
@@ -334,57 +336,121 @@ def crispr_test(tab,ctrlg,testg, destfile,sgrna2genelist,args):
   #
   # prepare files for gene test
   if sgrna2genelist is not None:
-    destfname=destfile+'.plow.txt';
-    destf=open(destfname,'w');
     destkeys=tabctrl.keys();
     sort_id=[i[0] for i in sorted(enumerate(tt_p_lower_score), key=lambda x:x[1],reverse=False)];
-    # output to file
-    print('\t'.join(['sgrna','symbol','pool','p.low','prob','chosen']),file=destf);
-    for i in sort_id:
-      report=[destkeys[i], sgrna2genelist[destkeys[i]],'list', tt_p_lower_score[i], '1', validsgrna[i]];
-      print('\t'.join([str(x) for x in report]),file=destf);
-    destf.close();
+    # rows of the .plow.txt file
+    rralow=[[destkeys[i], sgrna2genelist[destkeys[i]],'list', tt_p_lower_score[i], '1', validsgrna[i]] for i in sort_id];
     tt_p_lower_fdr=pFDR(tt_p_lower,method=args.adjust_method);
     n_lower=sum([1 for x in tt_p_lower if x <= args.gene_test_fdr_threshold]);
     n_lower_p=n_lower*1.0/len(tt_p_lower);
     logging.debug('lower test FDR cutoff: '+str(n_lower_p));
     #
-    destfname=destfile+'.phigh.txt';
-    destf=open(destfname,'w');
     destkeys=tabctrl.keys();
     sort_id=[i[0] for i in sorted(enumerate(tt_p_higher_score), key=lambda x:x[1],reverse=False)];
-    # output to file
-    print('\t'.join(['sgrna','symbol','pool','p.high','prob','chosen']),file=destf);
-    for i in sort_id:
-      report=[destkeys[i], sgrna2genelist[destkeys[i]],'list', tt_p_higher_score[i], '1', validsgrna[i]];
-      print('\t'.join([str(x) for x in report]),file=destf);
-    destf.close();
+    # rows of the .phigh.txt file
+    rrahigh=[[destkeys[i], sgrna2genelist[destkeys[i]],'list', tt_p_higher_score[i], '1', validsgrna[i]] for i in sort_id];
     tt_p_higher_fdr=pFDR(tt_p_higher,method=args.adjust_method);
     n_higher=sum([1 for x in tt_p_higher if x <= args.gene_test_fdr_threshold]);
     n_higher_p=n_higher*1.0/len(tt_p_higher);
     logging.debug('higher test FDR cutoff: '+str(n_higher_p));
     # 
-    return (n_lower_p,n_higher_p);
+    return (n_lower_p,n_higher_p,rralow,rrahigh);
   else:
-    return (None,None);
+    return (None,None,None,None);
 
-def rank_association_test(file,outfile,cutoff,args):
+def rank_association_test(file,outfile,cutoff,args,rows=None,rowheader=None,writeinput=True,writeoutput=True):
+  '''
+  Rank association test by RRA
+  Parameters:
+    file, outfile: the input and output files of RRA
+    rows: the input rows of RRA (see write_rank_input), or None if they are in file already
+    rowheader: the header of file
+    writeinput, writeoutput: whether to write file and outfile when RRA runs in memory
+  Return:
+    a list of [group, items in group, lo-value, p, FDR, goodsgrna] in the order of outfile (see read_rank_file)
+  Given the rows, RRA runs in memory if the RRA library is available; otherwise the RRA command is called on file.
+  '''
   if cutoff<0.05:
     cutoff=0.05;
   if cutoff>0.5:
     cutoff=0.5;
+  if rows is not None:
+    results=None;
+    if load_librra() is not None:
+      controlnames=None;
+      if hasattr(args,'control_sgrna') and args.control_sgrna != None :
+        controlnames=[line.strip() for line in open(args.control_sgrna) if line.strip()!=''];
+      results=rra_run(rows,cutoff,controlnames);
+    if results is not None:
+      if writeinput:
+        write_rank_input(rows,file,rowheader);
+      if writeoutput:
+        write_rank_file(results,outfile);
+      return results;
+    write_rank_input(rows,file,rowheader);
   #rrapath='/'.join(sys.argv[0].split('/')[:-1]+["../bin/RRA"])
   rrapath='RRA';
   command=rrapath+" -i "+file+" -o "+outfile+" -p "+str(cutoff);
   if hasattr(args,'control_sgrna') and args.control_sgrna != None :
     command+=" --control "+args.control_sgrna;
   systemcall(command);
+  return read_rank_file(outfile);
   
 
+def rank_association_test_dualtail(prefix,lowcutoff,highcutoff,args,lowrows,highrows):
+  '''
+  Rank association test by RRA in both directions, writing the merged gene summary prefix.gene_summary.txt
+  Parameters:
+    prefix: the prefix of the output files
+    lowcutoff, highcutoff: the percentile cutoffs of the negative and the positive selection
+    lowrows, highrows: the input rows of the negative and the positive selection (see write_rank_input); the scores of
+      highrows are the negated scores of lowrows
+  The input is read once and both directions are run by RRA (--dual-tail), in memory if the RRA library is available.
+  With --keep-tmp, the input and output files of each direction (.plow.txt, .gene.low.txt, ...) are kept as well,
+  except for the output of each direction when the RRA command is used.
+  Return:
+    (negative selection, positive selection) results, each in the order of its RRA output (see read_rank_file)
+  '''
+  if lowcutoff<0.05:
+    lowcutoff=0.05;
+  if lowcutoff>0.5:
+    lowcutoff=0.5;
+  if highcutoff<0.05:
+    highcutoff=0.05;
+  if highcutoff>0.5:
+    highcutoff=0.5;
+  sortpos=(hasattr(args,'sort_criteria') and args.sort_criteria=='pos');
+  controlnames=None;
+  if hasattr(args,'control_sgrna') and args.control_sgrna != None :
+    controlnames=[line.strip() for line in open(args.control_sgrna) if line.strip()!=''];
+  if args.keep_tmp:
+    write_rank_input(lowrows,prefix+'.plow.txt',['sgrna','symbol','pool','p.low','prob','chosen']);
+    write_rank_input(highrows,prefix+'.phigh.txt',['sgrna','symbol','pool','p.high','prob','chosen']);
+  results=None;
+  if load_librra() is not None:
+    results=rra_run_dualtail(lowrows,lowcutoff,highcutoff,prefix+'.gene_summary.txt',controlnames,sortpos,getresults=args.keep_tmp);
+  if results is not None:
+    if args.keep_tmp:
+      write_rank_file(results[0],prefix+'.gene.low.txt');
+      write_rank_file(results[1],prefix+'.gene.high.txt');
+      return results;
+    return read_rank_summary_file(prefix+'.gene_summary.txt');
+  if not args.keep_tmp:
+    write_rank_input(lowrows,prefix+'.plow.txt',['sgrna','symbol','pool','p.low','prob','chosen']);
+  rrapath='RRA';
+  command=rrapath+" -i "+prefix+'.plow.txt'+" -o "+prefix+'.gene_summary.txt'+" -p "+str(lowcutoff)+" --dual-tail --p-pos "+str(highcutoff);
+  if sortpos:
+    command+=" --sort-criteria pos";
+  if controlnames is not None:
+    command+=" --control "+args.control_sgrna;
+  systemcall(command);
+  return read_rank_summary_file(prefix+'.gene_summary.txt');
+
 def magecktest_removetmp(prefix):
   tmpfile=[prefix+'.plow.txt',prefix+'.phigh.txt',prefix+'.gene.low.txt',prefix+'.gene.high.txt'];
   for f in tmpfile:
-    systemcall('rm '+f,cmsg=False);
+    if os.path.isfile(f):
+      os.remove(f);
 
 
 
@@ -463,12 +529,9 @@ def magecktest_main(args):
       # perform sgRNA test, and prepare files for gene test
       gene_as_cutoff=crispr_test(nttab, controlgroup_ids, treatgroup_ids, cp_prefix,sgrna2genelist,args);  
       #
+      # gene test in both directions, written to the gene summary
       if gene_as_cutoff[0] is not None:
-        rank_association_test(cp_prefix+'.plow.txt',cp_prefix+'.gene.low.txt',gene_as_cutoff[0],args);
-      if gene_as_cutoff[1] is not None:
-        rank_association_test(cp_prefix+'.phigh.txt',cp_prefix+'.gene.high.txt',gene_as_cutoff[1],args);
-      # merge different files
-      merge_rank_files(cp_prefix+'.gene.low.txt',cp_prefix+'.gene.high.txt',cp_prefix+'.gene_summary.txt',args);
+        (rralow,rrahigh)=rank_association_test_dualtail(cp_prefix,gene_as_cutoff[0],gene_as_cutoff[1],args,gene_as_cutoff[2],gene_as_cutoff[3]);
       if cpindex>0:
         if cpindex>1:
           label1='';
@@ -484,11 +547,11 @@ def magecktest_main(args):
       vrv.cplabel=treatgroup_label+'_vs_'+controlgroup_label+' neg.';
       vrvrnwcplabel+=[vrv.cplabel];
       vrv.cpindex=[2+10*cpindex+1];
-      vrv.loadTopKWithExp(cp_prefix+'.gene.low.txt',nttab,sgrna2genelist,controlgrouplabellist+treatgrouplabellist);
+      vrv.loadTopKWithExp(rralow,nttab,sgrna2genelist,controlgrouplabellist+treatgrouplabellist);
       vrv.cplabel=treatgroup_label+'_vs_'+controlgroup_label+' pos.';
       vrvrnwcplabel+=[vrv.cplabel];
       vrv.cpindex=[2+10*cpindex+5+1];
-      vrv.loadTopKWithExp(cp_prefix+'.gene.high.txt',nttab,sgrna2genelist,controlgrouplabellist+treatgrouplabellist);
+      vrv.loadTopKWithExp(rrahigh,nttab,sgrna2genelist,controlgrouplabellist+treatgrouplabellist);
       
       # clean the file
       if args.keep_tmp==False:
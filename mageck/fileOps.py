@@ -99,57 +99,97 @@ def merge_rank_summary_files(lowfile,highfile,outfile,args,lowfile_prefix='',hig
  
 
 
-def merge_rank_files(lowfile,highfile,outfile,args):
+def read_rank_file(filename):
   """
-  Merge neg. and pos. selected files (generated by RRA) into one
+  Read the groups of a file generated by RRA, as a list of [group, items in group, lo-value, p, FDR, goodsgrna]
   """
-  gfile={};
-  # read files individually
+  results=[];
   nline=0;
-  for line in open(lowfile):
+  for line in open(filename):
     field=line.strip().split();
     nline+=1;
     if nline==1: # skip the first line
       continue;
     if len(field)<4:
-      logging.error('The number of fields in file '+lowfile+' is <4.');
+      logging.error('The number of fields in file '+filename+' is <4.');
       sys.exit(-1);
-    gid=field[0];
-    gitem=int(field[1]);
-    g_lo=float(field[2]);
-    g_p=float(field[3]);
-    g_fdr=float(field[4]);
-    g_goodsgrna=int(field[5]);
-    gfile[gid]=[(gitem,g_lo,g_p,g_fdr,nline-1,g_goodsgrna)];
-  maxnline=nline;
+    results+=[[field[0],int(field[1]),float(field[2]),float(field[3]),float(field[4]),int(field[5])]];
+  return results;
+
+def read_rank_summary_file(filename):
+  """
+  Read the negative and the positive selection of a merged summary (see merge_rank_results), each as a list of
+  [group, items in group, lo-value, p, FDR, goodsgrna] in the order of its rank
+  """
+  lowres=[];
+  highres=[];
   nline=0;
-  for line in open(highfile):
+  for line in open(filename):
     field=line.strip().split();
     nline+=1;
     if nline==1: # skip the first line
       continue;
-    if len(field)<4:
-      logging.error('The number of fields in file '+highfile+' is <4.');
+    if len(field)<12:
+      logging.error('The number of fields in file '+filename+' is <12.');
       sys.exit(-1);
-    gid=field[0];
-    gitem=int(field[1]);
-    g_lo=float(field[2]);
-    g_p=float(field[3]);
-    g_fdr=float(field[4]);
-    g_goodsgrna=int(field[5]);
+    lowres+=[(int(field[5]),[field[0],int(field[1]),float(field[2]),float(field[3]),float(field[4]),int(field[6])])];
+    highres+=[(int(field[10]),[field[0],int(field[1]),float(field[7]),float(field[8]),float(field[9]),int(field[11])])];
+  lowres=[x[1] for x in sorted(lowres,key=lambda x: x[0])];
+  highres=[x[1] for x in sorted(highres,key=lambda x: x[0])];
+  return (lowres,highres);
+
+def write_rank_input(rows,filename,header):
+  """
+  Write the input rows of RRA ([item, group(s), list, score] and optionally the probability and the chosen flag)
+  """
+  ofhd=open(filename,'w');
+  print('\t'.join(header),file=ofhd);
+  for r in rows:
+    print('\t'.join([str(x) for x in r]),file=ofhd);
+  ofhd.close();
+
+def write_rank_file(results,filename):
+  """
+  Write the groups returned by read_rank_file or the RRA library in the format of RRA
+  """
+  ofhd=open(filename,'w');
+  print('\t'.join(['group_id','items_in_group','lo_value','p','FDR','goodsgrna']),file=ofhd);
+  for r in results:
+    print('%s\t%d\t%10.4e\t%10.4e\t%f\t%d' % tuple(r),file=ofhd);
+  ofhd.close();
+
+def merge_rank_files(lowfile,highfile,outfile,args):
+  """
+  Merge neg. and pos. selected files (generated by RRA) into one
+  """
+  merge_rank_results(read_rank_file(lowfile),read_rank_file(highfile),outfile,args,lowname=lowfile,highname=highfile);
+
+def merge_rank_results(lowres,highres,outfile,args,lowname='the negative selection',highname='the positive selection'):
+  """
+  Merge neg. and pos. selected groups (generated by RRA, see read_rank_file) into one file
+  """
+  gfile={};
+  nline=0;
+  for (gid,gitem,g_lo,g_p,g_fdr,g_goodsgrna) in lowres:
+    nline+=1;
+    gfile[gid]=[(gitem,g_lo,g_p,g_fdr,nline,g_goodsgrna)];
+  maxnline=nline+1;
+  nline=0;
+  for (gid,gitem,g_lo,g_p,g_fdr,g_goodsgrna) in highres:
+    nline+=1;
     if gid not in gfile:
-      logging.warning('Item '+gid+' appears in '+highfile+', but not in '+lowfile+'.');
+      logging.warning('Item '+gid+' appears in '+highname+', but not in '+lowname+'.');
       #gfile[gid]=[('NA',1.0,1.0,maxnline)];
       gfile[gid]=[(1.0,1.0,1.0,maxnline,0)]; # note that gitem is not saved
     else:
       #gfile[gid]+=[(gitem,g_p,g_fdr,nline-1)];
       if gfile[gid][0][0]!=gitem:
         logging.warning('Item number of '+gid+' does not match previous file: '+str(gitem)+' !='+str(gfile[gid][0][0])+'.');
-      gfile[gid]+=[(g_lo,g_p,g_fdr,nline-1,g_goodsgrna)]; # don't repeat the gitem
+      gfile[gid]+=[(g_lo,g_p,g_fdr,nline,g_goodsgrna)]; # don't repeat the gitem
   # check whether some items appear in the first group, but not in the second group
   for (k,v) in gfile.iteritems():
     if len(v)==1:
-      logging.warning('Item '+gid+' appears in '+lowfile+', but not in '+highfile+'.');
+      logging.warning('Item '+gid+' appears in '+lowname+', but not in '+highname+'.');
       #gfile[gid]+=[('NA',1.0,1.0,maxnline)];
       gfile[gid]+=[(1.0,1.0,1.0,maxnline,0)];
       
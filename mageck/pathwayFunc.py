@@ -13,6 +13,7 @@ the distribution).
 
 from __future__ import print_function
 from crisprFunction import *
+import os;
 import random;
 import sys;
 import logging;
@@ -92,7 +93,8 @@ def mageck_removetmprra(args):
     tmpfile=[args.output_prefix+'.pathway.low.tmp',args.output_prefix+'.pathway.high.tmp',args.output_prefix+'.pathway.low.txt',args.output_prefix+'.pathway.high.txt'];
   
   for f in tmpfile:
-    systemcall('rm '+f,cmsg=False);
+    if os.path.isfile(f):
+      os.remove(f);
 
 def mageck_pathwayrra(args):
   """perform pathway anaylsis using RRA
@@ -102,7 +104,7 @@ def mageck_pathwayrra(args):
   fname=args.gene_ranking;
   if args.single_ranking:
     columnid=args.ranking_column;
-    mageck_pathwayrra_onedir(args,pdict,columnid,fname,args.output_prefix+'.pathway.tmp',args.output_prefix+'.pathway.txt');
+    mageck_pathwayrra_onedir(args,pdict,columnid,fname,args.output_prefix+'.pathway.tmp',args.output_prefix+'.pathway.txt',writeoutput=True);
     # columnid=2; # default: 3rd column (neg. selected p values)
   else:
     tmppath_low=args.output_prefix+'.pathway.low.tmp';
@@ -110,24 +112,23 @@ def mageck_pathwayrra(args):
     rraout_low=args.output_prefix+'.pathway.low.txt'
     rraout_high=args.output_prefix+'.pathway.high.txt'
     columnid=args.ranking_column;
-    mageck_pathwayrra_onedir(args,pdict,columnid,fname,tmppath_low,rraout_low);
+    rralow=mageck_pathwayrra_onedir(args,pdict,columnid,fname,tmppath_low,rraout_low,writeoutput=args.keep_tmp);
     columnid=args.ranking_column_2; # columnid=6 if sgRNA number in positive selection is not omitted
-    mageck_pathwayrra_onedir(args,pdict,columnid,fname,tmppath_high,rraout_high);
+    rrahigh=mageck_pathwayrra_onedir(args,pdict,columnid,fname,tmppath_high,rraout_high,writeoutput=args.keep_tmp);
     # merge different files
-    merge_rank_files(rraout_low,rraout_high,args.output_prefix+'.pathway_summary.txt',args);
+    merge_rank_results(rralow,rrahigh,args.output_prefix+'.pathway_summary.txt',args,lowname=rraout_low,highname=rraout_high);
   
   if args.keep_tmp==False:
     mageck_removetmprra(args);
 
-def mageck_pathwayrra_onedir(args,pdict,cid,sourcefile,rra_path_input_file,rra_path_output_file):
+def mageck_pathwayrra_onedir(args,pdict,cid,sourcefile,rra_path_input_file,rra_path_output_file,writeoutput=True):
   '''
-  Calling RRA for pathway test
+  Calling RRA for pathway test; return the RRA results (see rank_association_test)
   '''
   logging.debug('Performing pathway ranking test; input:'+rra_path_input_file+', output:'+rra_path_output_file);
-  # preparing input files
+  # preparing input rows
   # rra_path_input_file=args.output_prefix+'.pathway.tmp';
-  rra_path_input=open(rra_path_input_file,'w');
-  print('\t'.join(['gene','pathway','pool','score']),file=rra_path_input);
+  rra_path_input=[];
   
   ginfo=mageck_readgeneranking(sourcefile,args,columnid=cid);
   ginfo_st=sorted(ginfo.iteritems(),key=lambda x: x[1]);
@@ -156,14 +157,13 @@ def mageck_pathwayrra_onedir(args,pdict,cid,sourcefile,rra_path_input_file,rra_p
       if genename in v:
         pnamelist+=[k];
     if len(pnamelist)==0:
-      print('\t'.join([genename,'NA','list',str(gscore)]),file=rra_path_input);
+      rra_path_input+=[[genename,'NA','list',gscore]];
     else:
-      print('\t'.join([genename,','.join(pnamelist),'list',str(gscore)]),file=rra_path_input);
-  rra_path_input.close();
+      rra_path_input+=[[genename,','.join(pnamelist),'list',gscore]];
   rra_threshold=nthreshold*1.0/len(ginfo_st);
   
   # rank association test
-  rank_association_test(rra_path_input_file,rra_path_output_file,rra_threshold,args);
+  return rank_association_test(rra_path_input_file,rra_path_output_file,rra_threshold,args,rows=rra_path_input,rowheader=['gene','pathway','pool','score'],writeinput=args.keep_tmp,writeoutput=writeoutput);
   
 def mageck_pathway_standardize(gdict):
   '''
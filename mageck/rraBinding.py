@@ -0,0 +1,196 @@
+#!/usr/bin/env python
+"""MAGeCK binding of the RRA library
+Copyright (c) 2014 Wei Li, Han Xu, Xiaole Liu lab
+This code is free software; you can redistribute it and/or modify it
+under the terms of the BSD License (see the file COPYING included with
+the distribution).
+@status:  experimental
+@version: $Revision$
+@author:  Wei Li
+@contact: li.david.wei AT gmail.com
+"""
+
+from __future__ import print_function
+import os
+import ctypes
+import logging
+
+
+class RRAOptions(ctypes.Structure):
+  """
+  RRA_OPTIONS of rra/include/librra.h
+  """
+  _fields_=[('maxPercentile',ctypes.c_double),
+    ('threadNum',ctypes.c_int),
+    ('loValueMethod',ctypes.c_int),
+    ('rngMethod',ctypes.c_int),
+    ('pvalueMethod',ctypes.c_int),
+    ('minPValue',ctypes.c_double),
+    ('pvalueError',ctypes.c_double),
+    ('nullCacheDir',ctypes.c_char_p),
+    ('controlNames',ctypes.POINTER(ctypes.c_char_p)),
+    ('controlNum',ctypes.c_int)];
+
+class RRAResult(ctypes.Structure):
+  """
+  RRA_RESULT of rra/include/librra.h
+  """
+  _fields_=[('groupNum',ctypes.c_int),
+    ('name',ctypes.POINTER(ctypes.c_char_p)),
+    ('itemNum',ctypes.POINTER(ctypes.c_int)),
+    ('loValue',ctypes.POINTER(ctypes.c_double)),
+    ('pvalue',ctypes.POINTER(ctypes.c_double)),
+    ('fdr',ctypes.POINTER(ctypes.c_double)),
+    ('goodsgrna',ctypes.POINTER(ctypes.c_int)),
+    ('nameChars',ctypes.c_void_p)];
+
+_librra=None;
+_librra_searched=False;
+
+def load_librra():
+  """
+  Load librra.so: from $MAGECK_LIBRRA, next to this module (installed) or in ../bin (source tree).
+  Return None if it is not found, in which case the RRA command is used instead
+  """
+  global _librra,_librra_searched;
+  if _librra_searched:
+    return _librra;
+  _librra_searched=True;
+  moddir=os.path.dirname(os.path.abspath(__file__));
+  candidates=[os.path.join(moddir,'librra.so'),os.path.join(moddir,'..','bin','librra.so')];
+  if 'MAGECK_LIBRRA' in os.environ:
+    candidates=[os.environ['MAGECK_LIBRRA']]+candidates;
+  for libpath in candidates:
+    if not os.path.isfile(libpath):
+      continue;
+    try:
+      lib=ctypes.CDLL(libpath);
+    except OSError:
+      logging.warning('Cannot load the RRA library '+libpath+'.');
+      continue;
+    lib.RraDefaultOptions.argtypes=[ctypes.POINTER(RRAOptions)];
+    lib.RraDefaultOptions.restype=None;
+    lib.RraRun.argtypes=[ctypes.POINTER(RRAOptions),ctypes.c_int,
+      ctypes.POINTER(ctypes.c_char_p),ctypes.POINTER(ctypes.c_char_p),ctypes.POINTER(ctypes.c_char_p),
+      ctypes.POINTER(ctypes.c_double),ctypes.POINTER(ctypes.c_double),ctypes.POINTER(ctypes.c_int),
+      ctypes.POINTER(RRAResult)];
+    lib.RraRun.restype=ctypes.c_int;
+    lib.RraRunDualTail.argtypes=[ctypes.POINTER(RRAOptions),ctypes.c_double,ctypes.c_int,
+      ctypes.POINTER(ctypes.c_char_p),ctypes.POINTER(ctypes.c_char_p),ctypes.POINTER(ctypes.c_char_p),
+      ctypes.POINTER(ctypes.c_double),ctypes.POINTER(ctypes.c_double),ctypes.POINTER(ctypes.c_int),
+      ctypes.c_char_p,ctypes.c_int,ctypes.POINTER(RRAResult),ctypes.POINTER(RRAResult)];
+    lib.RraRunDualTail.restype=ctypes.c_int;
+    lib.RraFreeResult.argtypes=[ctypes.POINTER(RRAResult)];
+    lib.RraFreeResult.restype=None;
+    logging.debug('Using the RRA library '+libpath+'.');
+    _librra=lib;
+    break;
+  return _librra;
+
+def _tobytes(s):
+  s=str(s);
+  if isinstance(s,bytes):
+    return s;
+  return s.encode('utf-8');
+
+def _strarray(values):
+  return (ctypes.c_char_p*len(values))(*[_tobytes(x) for x in values]);
+
+def _rowarrays(rows):
+  """
+  The row arrays of RraRun and RraRunDualTail: item, group, list, value, probability and chosen flag
+  """
+  n=len(rows);
+  itemarray=_strarray([x[0] for x in rows]);
+  grouparray=_strarray([x[1] for x in rows]);
+  listarray=_strarray([x[2] for x in rows]);
+  valuearray=(ctypes.c_double*n)(*[float(x[3]) for x in rows]);
+  probarray=(ctypes.c_double*n)(*[(float(x[4]) if len(x)>4 else 1.0) for x in rows]);
+  chosenarray=(ctypes.c_int*n)(*[(int(x[5]) if len(x)>5 else 1) for x in rows]);
+  return (itemarray,grouparray,listarray,valuearray,probarray,chosenarray);
+
+def _options(lib,cutoff,controlnames):
+  """
+  The options of RraRun and RraRunDualTail; the control name array is returned too, as the options only point to it
+  """
+  opts=RRAOptions();
+  lib.RraDefaultOptions(ctypes.byref(opts));
+  opts.maxPercentile=cutoff;
+  ctrlarray=None;
+  if controlnames is not None:
+    ctrlarray=_strarray(controlnames);
+    opts.controlNames=ctrlarray;
+    opts.controlNum=len(controlnames);
+  return (opts,ctrlarray);
+
+def _results(lib,res):
+  """
+  Convert a result of the library to a list of [group, items in group, lo-value, p, FDR, goodsgrna], and release it
+  """
+  results=[];
+  for i in range(res.groupNum):
+    gname=res.name[i];
+    if not isinstance(gname,str):
+      gname=gname.decode('utf-8');
+    results+=[[gname,res.itemNum[i],float('%10.4e' % res.loValue[i]),float('%10.4e' % res.pvalue[i]),float('%f' % res.fdr[i]),res.goodsgrna[i]]];
+  lib.RraFreeResult(ctypes.byref(res));
+  return results;
+
+def rra_run(rows,cutoff,controlnames=None):
+  """
+  Run RRA in this process.
+  Parameters:
+    rows: a list of [item, group(s), list, score] rows, optionally followed by the probability and the chosen flag;
+      several groups are separated by ','
+    cutoff: the maximum percentile (-p) of RRA
+    controlnames: a list of control sgRNA names, or None
+  Return:
+    a list of [group, items in group, lo-value, p, FDR, goodsgrna] in the order of the RRA output file,
+    with the precision of that file; None if the library is not available or fails
+  """
+  lib=load_librra();
+  if lib is None:
+    return None;
+  (opts,ctrlarray)=_options(lib,cutoff,controlnames);
+  (itemarray,grouparray,listarray,valuearray,probarray,chosenarray)=_rowarrays(rows);
+  res=RRAResult();
+  if lib.RraRun(ctypes.byref(opts),len(rows),itemarray,grouparray,listarray,valuearray,probarray,chosenarray,ctypes.byref(res))<=0:
+    logging.error('The RRA library failed.');
+    return None;
+  return _results(lib,res);
+
+def rra_run_dualtail(rows,lowcutoff,highcutoff,summaryfile,controlnames=None,sortpos=False,getresults=False):
+  """
+  Run RRA in this process in both directions: negative selection on the scores of rows, and positive selection on the
+  negated scores, as the --dual-tail option of the RRA command does.
+  Parameters:
+    rows: the rows of the negative selection (see rra_run)
+    lowcutoff, highcutoff: the maximum percentile of the negative and the positive selection
+    summaryfile: the merged summary file to write (the format of merge_rank_results)
+    controlnames: a list of control sgRNA names, or None
+    sortpos: sort the summary by positive selection instead of negative selection
+    getresults: whether to return the results of each direction
+  Return:
+    (negative selection, positive selection) results as by rra_run if getresults, otherwise (None, None);
+    None if the library is not available or fails
+  """
+  lib=load_librra();
+  if lib is None:
+    return None;
+  (opts,ctrlarray)=_options(lib,lowcutoff,controlnames);
+  (itemarray,grouparray,listarray,valuearray,probarray,chosenarray)=_rowarrays(rows);
+  lowres=RRAResult();
+  highres=RRAResult();
+  if getresults:
+    lowptr=ctypes.byref(lowres);
+    highptr=ctypes.byref(highres);
+  else:
+    lowptr=None;
+    highptr=None;
+  if lib.RraRunDualTail(ctypes.byref(opts),highcutoff,len(rows),itemarray,grouparray,listarray,valuearray,probarray,chosenarray,
+      _tobytes(summaryfile),int(sortpos),lowptr,highptr)<=0:
+    logging.error('The RRA library failed.');
+    return None;
+  if getresults:
+    return (_results(lib,lowres),_results(lib,highres));
+  return (None,None);
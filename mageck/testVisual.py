@@ -162,8 +162,13 @@ class VisualRValue:
   
   def loadTopK(self, filename, k=10):
     '''
-    Load the top k gene names from the file
+    Load the top k gene names from the file, or from the RRA results in memory (see read_rank_file)
     '''
+    if isinstance(filename,list):
+      self.targetgene=[x[0] for x in filename[:k]];
+      logging.info('Loading top '+str(k) +' genes: '+','.join(self.targetgene));
+      self.WriteRTemplate();
+      return 0;
     n=-1;
     self.targetgene=[];
     for line in open(filename):
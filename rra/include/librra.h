@@ -0,0 +1,74 @@
+/*
+ *  librra.h
+ *  C interface of the Robust Rank Aggregation (RRA) library, for callers that hold the ranked
+ *  items in memory: the same analysis as the RRA command without its input and output files.
+ *
+ */
+#ifndef LIBRRA_H
+#define LIBRRA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RRA_LOVALUE_ORDERSTAT 0    //lo-values from the binomial order-statistic kernel (default)
+#define RRA_LOVALUE_BETAIN 1       //lo-values from the incomplete beta function
+#define RRA_RNG_LEHMER 0           //Lehmer random generator, null drawn per group as in earlier releases
+#define RRA_RNG_PHILOX 1           //Philox4x32-10 random generator (default)
+#define RRA_PVALUE_PERMUTATION 0   //p-values from random passes (default)
+#define RRA_PVALUE_EXACT 1         //p-values from the exact null distribution of the lo-value
+
+typedef struct // options of one analysis; the command line option of the RRA command is given for each field
+{
+	double maxPercentile;          //-p: percentile cutoff of the lo-values
+	int threadNum;                 //--threads: 0 for all available cores
+	int loValueMethod;             //--lovalue-method, RRA_LOVALUE_*
+	int rngMethod;                 //--rng, RRA_RNG_*
+	int pvalueMethod;              //--pvalue-method, RRA_PVALUE_*
+	double minPValue;              //--min-pvalue, 0 if not used
+	double pvalueError;            //--pvalue-error, 0 if not used
+	const char *nullCacheDir;      //--null-cache, NULL if not used
+	const char *const *controlNames; //--control: names of the control items, NULL if not used
+	int controlNum;                //number of control names
+} RRA_OPTIONS;
+
+typedef struct // results of the groups, as parallel arrays in the order of the RRA output file
+{
+	int groupNum;                  //number of groups
+	const char **name;             //group name
+	int *itemNum;                  //number of items in the group
+	double *loValue;               //lo-value
+	double *pvalue;                //p-value
+	double *fdr;                   //false discovery rate
+	int *goodsgrna;                //number of items below the percentile cutoff
+	char *nameChars;               //storage of the group names
+} RRA_RESULT;
+
+//Fill in the defaults of the RRA command
+void RraDefaultOptions(RRA_OPTIONS *options);
+
+//Rank aggregation of rowNum ranked items. Row i is item itemName[i] of list listName[i] with value value[i], in the
+//groups of groupName[i] (several separated by ","); prob and isChosen may be NULL for probability 1 and all rows chosen.
+//Fills result, to be released with RraFreeResult. Return 1 if success, -1 if failure.
+//Calls may run at the same time on several threads; overlapping calls share the worker pool of the first one
+int RraRun(const RRA_OPTIONS *options, int rowNum, const char *const *itemName, const char *const *groupName,
+		   const char *const *listName, const double *value, const double *prob, const int *isChosen, RRA_RESULT *result);
+
+//Rank aggregation of the same rows in both directions (the --dual-tail option of the RRA command): negative selection on
+//value with the cutoff options->maxPercentile, and positive selection on -value with the cutoff posMaxPercentile. The
+//rows are loaded once and the null lo-values are shared when the cutoffs are equal. Unless summaryFileName is NULL, the
+//merged summary is saved to it, sorted by the positive selection if sortByPos is not 0. negResult and posResult may be
+//NULL, otherwise they are filled as by RraRun. Return 1 if success, -1 if failure
+int RraRunDualTail(const RRA_OPTIONS *options, double posMaxPercentile, int rowNum, const char *const *itemName,
+				   const char *const *groupName, const char *const *listName, const double *value, const double *prob,
+				   const int *isChosen, const char *summaryFileName, int sortByPos, RRA_RESULT *negResult,
+				   RRA_RESULT *posResult);
+
+//Release the arrays of a result
+void RraFreeResult(RRA_RESULT *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,12 +13,19 @@ typedef struct
 	int index;
 }INDEXED_FLOAT;
 
-//Quicksort an array in real values, in ascending order
+//Quicksort an array in real values, in ascending order. Robust to ties and presorted input
 void QuicksortF(double *a, int lo, int hi);
 
-//Quicksort an indexed array, in ascending order 
+//Quicksort an indexed array, in ascending order. Robust to ties and presorted input
 void QuicksortIndexedArray(INDEXED_FLOAT *a, int lo, int hi);
 
+//Sort an array in real values, in ascending order. Large arrays use a parallel radix sort
+void SortF(double *a, int n);
+
+//Sort an indexed array by value, in ascending order. Stable: entries with equal values keep their input order.
+//Large arrays use a parallel radix sort
+void SortIndexedArray(INDEXED_FLOAT *a, int n);
+
 //BTreeSearchingF: Searching value in array, which was organized in ascending order previously
 int  bTreeSearchingF(double value, double *a, int lo, int hi);
 
@@ -42,3 +49,25 @@ void PermuteFloatArrays(double *a, int size);
 
 //Compute CDF of a non-central beta distribution. when lambda is 0.0, it's cpf of beta distribution
 double BetaNoncentralCdf(double a, double b, double lambda, double x, double error_max);
+
+//Build the cached tables used by BetaIntegerCdf and OrderStatisticCdf, covering groups of up to maxNum items.
+//Each call is paired with a FreeBetaIntegerCdf; analyses running at the same time share the tables
+void InitBetaIntegerCdf(int maxNum);
+
+//Release the tables built by InitBetaIntegerCdf, once every call has been paired
+void FreeBetaIntegerCdf(void);
+
+//CDF of a central beta distribution with integer shapes a and b. Same value as BetaNoncentralCdf(a,b,0.0,x,...)
+double BetaIntegerCdf(int a, int b, double x);
+
+//CDF of the (rank+1)-th smallest of num uniforms at x; same value as BetaIntegerCdf(rank+1,num-rank,x)
+double OrderStatisticCdfAt(int rank, int num, double x);
+
+//CDFs of the order statistics of num uniforms at ascending values x: cdf[i]=P(X_(i+1)<=x[i])=BetaIntegerCdf(i+1,num-i,x[i]), for i<rankNum
+void OrderStatisticCdf(const double *x, int num, int rankNum, double *cdf);
+
+//Quantile of the (rank+1)-th smallest of num uniforms: the x>=lo with OrderStatisticCdfAt(rank,num,x)=q
+double OrderStatisticQuantile(int rank, int num, double q, double lo);
+
+//P(X_(i+1)<=bound[i] for some i<rankNum), over the order statistics of num uniforms, for ascending bounds. work holds 2*rankNum values
+double OrderStatisticCrossing(const double *bound, int num, int rankNum, double *work);
@@ -9,11 +9,29 @@
 #if !defined( _RNGS_ )
 #define _RNGS_
 
+#define RNG_LEHMER 0              /* Lehmer generator of Park & Miller       */
+#define RNG_PHILOX 1              /* Philox4x32-10 counter-based generator  */
+
+typedef struct {                  /* state of one random sequence           */
+  int                method;      /* RNG_LEHMER or RNG_PHILOX               */
+  long               lehmer;      /* Lehmer state                           */
+  unsigned int       key[2];      /* Philox key: seed and stream            */
+  unsigned long long counter;     /* Philox counter of the next block       */
+  unsigned int       block[4];    /* current Philox block                   */
+  int                used;        /* values of the block already returned   */
+} RNG_STATE;
+
 double Random(void);
 void   PlantSeeds(long x);
 void   GetSeed(long *x);
 void   PutSeed(long x);
 void   SelectStream(int index);
 void   TestRandom(void);
+double RandomState(long *x);
+long   JumpSeed(long x, long long steps);
+void   SelectGenerator(int method);
+void   InitRngState(RNG_STATE *state, int method, long x, long long index, long long offset);
+double RandomFromState(RNG_STATE *state);
+void   RandomFill(RNG_STATE *state, double *u, int n);
 
 #endif
@@ -14,189 +14,783 @@
 #include "rngs.h"
 #include "classdef.h"
 #include "fileio.h"
+#include "threadpool.h"
+#include "nullcache.h"
+#include "rracore.h"
 
 //C++ functions
+#include <math.h>
 #include <string>
 #include <vector>
-#include <map>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
 using namespace std;
 
-int PRINT_DEBUG=0;
+//Function declarations
 
-//Global variables
+//Sort the items of a list by value and assign each item its percentile in the list
+void AssignListPercentiles(ITEM_ARENA *items, LIST_STRUCT *list);
 
-//store control sequences
-bool UseControlSeq=false;
-map<string,int> ControlSeqMap; //save the control sequence name and their index in ControlSeqPercentile;
-double* ControlSeqPercentile;
+//Process groups by computing percentiles for each item and lo-values for each group
+int ProcessGroups(RRA_CONTEXT *context, ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum,
+				  double maxPercentile);
 
-// used for calculation of lo-values
-double* tmpLovarray=NULL;
-int nLovarray=-1;
+//Find the item of each control sequence among the chosen items. Return the number of control sequences found
+int ResolveControlSeq(RRA_CONTEXT *context, const ITEM_ARENA *items, const NAME_POOL *itemNames);
 
+//Order groups by loValue. order[k] receives the index of the group with the k-th smallest lo-value
+void SortGroupsByLoValue(const GROUP_STRUCT *groups, int groupNum, int *order);
 
-//Function declarations
+//p-values from random passes over all groups, pooled into one null distribution
+int ComputePermutationPValues(const RRA_CONTEXT *context, const ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum,
+							  double maxPercentile, int scanPass, double minPValue, double relError);
 
-//Process groups by computing percentiles for each item and lo-values for each group
-int ProcessGroups(GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, double maxPercentile);
+//Histogram of null lo-values over the sorted query values of the groups
+void InitNullHistogram(NULL_HISTOGRAM *hist, int bucketNum);
+void ClearNullHistogram(NULL_HISTOGRAM *hist);
+void FreeNullHistogram(NULL_HISTOGRAM *hist);
+void AddSortedNullValues(NULL_HISTOGRAM *hist, const double *queries, const double *values, int valueNum);
+void MergeNullHistogram(NULL_HISTOGRAM *dst, const NULL_HISTOGRAM *src);
+
+//Position of a query value in a sorted null, as found by bTreeSearchingF, from the null values around it
+double NullPosition(double query, double below, double pred, double succ, double nullNum);
+
+//Positions of the query values in the sorted null counted by a histogram, as found by bTreeSearchingF
+void NullHistogramPositions(const NULL_HISTOGRAM *hist, const double *queries, long long nullNum, long long *position);
+
+//Null lo-values simulated once per distinct group size, extended in batches of random passes
+int InitNullStrata(NULL_STRATA *nullStrata, const RRA_CONTEXT *context, const ITEM_ARENA *items, const GROUP_STRUCT *groups,
+				   int groupNum, double maxPercentile);
+void StartNullStrata(NULL_STRATA *nullStrata, int passNum);
+void FinishNullStrata(NULL_STRATA *nullStrata);
+void FreeNullStrata(NULL_STRATA *nullStrata);
+
+//Start simulating the null strata of the first batch of passes before ProcessGroups, if the null allows it. 1 if started
+int StartUniformNull(const RRA_CONTEXT *context, const ITEM_ARENA *items, const GROUP_STRUCT *groups, int groupNum,
+					 double maxPercentile, int numOfRandPass, NULL_STRATA *nullStrata);
 
-//QuickSort groups by loValue
-void QuickSortGroupByLoValue(GROUP_STRUCT *groups, int start, int end);
+//p-values from null lo-values simulated once per distinct group size and weighted by the group-size histogram
+int ComputeStratifiedPValues(NULL_STRATA *nullStrata, GROUP_STRUCT *groups, int groupNum, int scanPass,
+							 double minPValue, double relError);
 
-//Compute False Discovery Rate based on uniform distribution
-int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int numOfRandPass);
+//Whether the null lo-value of every group only depends on its number of chosen items (no controls or sgRNA probabilities)
+bool UniformNullPercentiles(const RRA_CONTEXT *context, const ITEM_ARENA *items);
+
+//Number of random passes (the upper bound with adaptive passes); sets the adaptive minPValue and relError, if used
+int RandomPassNum(int groupNum, int numOfRandPass, double *minPValue, double *relError);
+
+//Number of random passes of the first batch
+int FirstPassNum(int scanPass, double relError);
+
+//Whether a p-value from random passes is resolved to the relative error relError, or known to be below minPValue
+bool PValueResolved(double count, double countVar, double nullNum, double minPValue, double relError);
+
+//p-values from the exact null distribution of the lo-value of each group size
+int ComputeExactPValues(const ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, double maxPercentile);
+
+//P(lo-value<=t) for num uniform percentiles. bound and work hold num and 2*num values
+double LoValueNullCdf(double t, int num, double maxPercentile, double *bound, double *work);
+
+//Compute False Discovery Rate based on uniform distribution. order receives the output order of the groups;
+//nullStrata: null strata started by StartUniformNull, or NULL
+int ComputeFDR(const RRA_CONTEXT *context, const ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, double maxPercentile,
+			   int numOfRandPass, int *order, NULL_STRATA *nullStrata);
 
 //print the usage of Command
 void PrintCommandUsage(const char *command);
 
 
 //Compute lo-value based on an array of percentiles
-int ComputeLoValue(double *percentiles,     //array of percentiles
+int ComputeLoValue(const RRA_CONTEXT *context, //options of the analysis
+				   double *percentiles,     //array of percentiles
 				   int num,                 //length of array
 				   double &loValue,         //pointer to the output lo-value
 				   double maxPercentile,   //maximum percentile, computation stops when maximum percentile is reached
-           int &goodsgrna);// # of good sgRNAs
+           int &goodsgrna,// # of good sgRNAs
+				   LOVALUE_SCRATCH *scratch); //work space of the calling thread
+
+//P(lo-value>t, with exactly c sgRNAs selected of which at least one within the cutoff)
+double ProbLoValueAbove(double t, const double *prob, const double *cdf, int goodNum, int c, const double *badCount,
+						int badNum, double *f);
 
 //WL: modification of lo_value computation
-int ComputeLoValue_Prob(double *percentiles,     //array of percentiles
+int ComputeLoValue_Prob(const RRA_CONTEXT *context, //options of the analysis
+				   double *percentiles,     //array of percentiles
 				   int num,                 //length of array
 				   double &loValue,         //pointer to the output lo-value
 				   double maxPercentile,   //maximum percentile, computation stops when maximum percentile is reached
 				  double *probValue,// probability of each prob, must be equal to the size of percentiles
-           int &goodsgrna);
+           int &goodsgrna,
+				   LOVALUE_SCRATCH *scratch); //work space of the calling thread
+
+//Set up and release the work space of ComputeLoValue and ComputeLoValue_Prob
+void InitLoValueScratch(LOVALUE_SCRATCH *scratch);
+void FreeLoValueScratch(LOVALUE_SCRATCH *scratch);
 
-//read control sequences
-int loadControlSeq(const char* fname){
+//read control sequences into an analysis context, one name per line; empty lines are skipped and repeated names kept once
+int loadControlSeq(RRA_CONTEXT *context, const char* fname){
 	ifstream fh;
   fh.open(fname);
   if(!fh.is_open()){
     cerr<<"Error opening "<<fname<<endl;
+    return -1;
   }
   string oneline;
-  int ncount=0;
-  ControlSeqMap.clear();
-  while(!fh.eof()){
-    getline(fh,oneline);
-    ControlSeqMap[oneline]=ncount;
-    ncount++;
+  int isNew;
+  if(!context->useControlSeq) InitNamePool(&context->controlSeqNames);
+  context->useControlSeq=true;
+  while(getline(fh,oneline)){
+    if(oneline.empty()) continue;
+    InternName(&context->controlSeqNames, oneline.c_str(), (int)oneline.size(), &isNew);
   }
   fh.close();
-  ControlSeqPercentile = new double[ncount];
-  for(int i=0;i<ncount;i++) ControlSeqPercentile[i]=-1.0;
-  cout<<ControlSeqMap.size()<<" control sequences loaded.\n";
+  cout<<context->controlSeqNames.nameNum<<" control sequences loaded.\n";
   return 0;
 }
 
-int main (int argc, const char * argv[]) {
-	int i,flag;
-	GROUP_STRUCT *groups;
-	int groupNum;
-	LIST_STRUCT *lists;
-	int listNum;
-	char inputFileName[1000], outputFileName[1000];
-	double maxPercentile;
+//Find the item of each control sequence among the chosen items, by name id, so that ProcessGroups and the random passes
+//only work with item indexes. A name listed in several rows resolves to its last chosen row. Returns the number of
+//control sequences found, or -1 if none is among the chosen items, as their percentiles would be an empty null
+int ResolveControlSeq(RRA_CONTEXT *context, const ITEM_ARENA *items, const NAME_POOL *itemNames){
+  int c, k;
+  const NAME_POOL *controlNames = &context->controlSeqNames;
+  int *nameControl = new int[itemNames->nameNum];  //control index of each item name, -1 if not a control
+  
+  for(k=0;k<(int)itemNames->nameNum;k++) nameControl[k]=-1;
+  context->controlSeqItem = new int[controlNames->nameNum];
+  for(c=0;c<(int)controlNames->nameNum;c++){
+    const char *name = GetName(controlNames, c);
+    unsigned int id = FindName(itemNames, name, (int)strlen(name));
+    
+    context->controlSeqItem[c]=-1;
+    if(id!=NAME_NONE) nameControl[id]=c;
+  }
+  for(k=0;k<items->itemNum;k++){
+    if(items->isChosen[k]==0) continue;
+    c=nameControl[items->nameId[k]];
+    if(c>=0) context->controlSeqItem[c]=k;
+  }
+  context->controlSeqNum=0;
+  for(c=0;c<(int)controlNames->nameNum;c++){
+    if(context->controlSeqItem[c]<0){
+      cerr<<"Warning: sgRNA "<<GetName(controlNames, c)<<" not found in the ranked list. \n";
+    }else{
+      context->controlSeqNum++;
+    }
+  }
+  delete []nameControl;
+  if(context->controlSeqNum==0){
+    delete []context->controlSeqItem;
+    context->controlSeqItem=NULL;
+    return -1;
+  }
+  context->controlSeqPercentile = new double[context->controlSeqNum];
+  return context->controlSeqNum;
+}
+
+//Set an analysis context to the defaults of the RRA command, without control sequences. The context holds no memory
+//until control sequences are loaded, so it may be copied as a template of other analyses
+void InitRraContext(RRA_CONTEXT *context)
+{
+	context->loValueMethod = LOVALUE_ORDERSTAT;
+	//RNG_LEHMER draws the null per group, in the order of earlier releases, and reproduces their results
+	context->rngMethod = RNG_PHILOX;
+	context->pvalueMethod = PVALUE_PERMUTATION;
+	context->minPValue = 0.0;
+	context->pvalueRelError = 0.0;
+	context->nullCacheDir = NULL;
+	context->printDebug = true;
+	context->useControlSeq = false;
+	memset(&context->controlSeqNames, 0, sizeof(NAME_POOL));
+	context->controlSeqItem = NULL;
+	context->controlSeqPercentile = NULL;
+	context->controlSeqNum = 0;
+	context->nullStore = NULL;
+}
+
+//Release the control sequences of an analysis context
+void FreeRraContext(RRA_CONTEXT *context)
+{
+	FreeNamePool(&context->controlSeqNames);
+	delete[] context->controlSeqItem;
+	delete[] context->controlSeqPercentile;
+	context->controlSeqItem = NULL;
+	context->controlSeqPercentile = NULL;
+	context->useControlSeq = false;
+}
+
+//Rank aggregation of the groups of an item arena: percentiles, lo-values, p-values and FDRs of the groups
+int RunRRA(RRA_CONTEXT *context, ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum,
+		   double maxPercentile, const NAME_POOL *itemNames, int *order)
+{
+	int i, flag;
+	int maxGroupItemNum;
+	NULL_STRATA nullStrata;
+	int nullStarted;
 	
-	//Parse the command line
-	if (argc == 1)
+	if (context->useControlSeq){
+		if (ResolveControlSeq(context, items, itemNames)<0){
+			cerr<<("\nError: none of the control sequences is found in the ranked list.\n");
+			return -1;
+		}
+	}
+	
+	//log-Gamma table for the beta CDFs of all group sizes
+	maxGroupItemNum = 0;
+	
+	for (i=0;i<groupNum;i++)
 	{
-		PrintCommandUsage(argv[0]);
-		return 0;
+		if (groups[i].itemNum>maxGroupItemNum)
+		{
+			maxGroupItemNum = groups[i].itemNum;
+		}
+	}
+	
+	InitBetaIntegerCdf(maxGroupItemNum);
+	
+	//the uniform null only depends on the group sizes: it is simulated on the workers while the lists are sorted
+	//and the observed lo-values computed. The loops of ProcessGroups still use every worker; the null takes them back after
+	nullStarted = StartUniformNull(context, items, groups, groupNum, maxPercentile, RAND_PASS_NUM*groupNum, &nullStrata);
+	flag = 1;
+	if (nullStarted<0){
+		cerr<<("\nError: opening the null lo-value cache failed.\n");
+		flag = -1;
+	}
+	
+	if (flag>0){
+		cerr<<("Computing lo-values for each group...\n");
+		if (ProcessGroups(context, items, groups, groupNum, lists, listNum, maxPercentile)<=0){
+			cerr<<("\nError: processing groups failed.\n");
+			flag = -1;
+		}
+	}
+	
+	if (flag>0){
+		cerr<<("Computing false discovery rate...\n");
+		if (ComputeFDR(context, items, groups, groupNum, maxPercentile, RAND_PASS_NUM*groupNum, order,
+					   (nullStarted>0)? &nullStrata : NULL)<=0){
+			cerr<<("\nError: computing FDR failed.\n");
+			flag = -1;
+		}
+	}
+	
+	//every path ends here: the null draws still running on the workers are joined before nullStrata goes out of scope
+	if (nullStarted>0){
+		FreeNullStrata(&nullStrata);
+	}
+	FreeBetaIntegerCdf();
+	delete[] context->controlSeqItem;
+	delete[] context->controlSeqPercentile;
+	context->controlSeqItem = NULL;
+	context->controlSeqPercentile = NULL;
+	
+	return flag;
+}
+
+//Rank aggregation in both directions over one item arena, sharing the null lo-values of equal cutoffs
+int RunDualTailRRA(RRA_CONTEXT *context, ITEM_ARENA *items, GROUP_STRUCT *negGroups, GROUP_STRUCT *posGroups, int groupNum,
+				   LIST_STRUCT *lists, int listNum, double negMaxPercentile, double posMaxPercentile,
+				   const NAME_POOL *itemNames, int *negOrder, int *posOrder)
+{
+	int k, flag;
+	NULL_STORE localStore;
+	NULL_STORE *savedStore = context->nullStore;
+	
+	//the strata simulated for one direction are found in the store by the other, as between the jobs of a batch
+	if (savedStore==NULL){
+		InitNullStore(&localStore);
+		context->nullStore = &localStore;
+	}
+	memcpy(posGroups, negGroups, groupNum*sizeof(GROUP_STRUCT));
+	
+	cerr<<("Negative selection...\n");
+	flag = RunRRA(context, items, negGroups, groupNum, lists, listNum, negMaxPercentile, itemNames, negOrder);
+	
+	if (flag>0){
+		cerr<<("Positive selection...\n");
+		for (k=0;k<items->itemNum;k++){
+			items->value[k] = -items->value[k];
+		}
+		flag = RunRRA(context, items, posGroups, groupNum, lists, listNum, posMaxPercentile, itemNames, posOrder);
+		for (k=0;k<items->itemNum;k++){
+			items->value[k] = -items->value[k];
+		}
+	}
+	
+	if (savedStore==NULL){
+		FreeNullStore(&localStore);
+		context->nullStore = NULL;
+	}
+	
+	return flag;
+}
+
+//Rank aggregation of contrast c of a matrix input. The contrast has its own percentiles, list order, groups and
+//control sequence state; the rest of the item arena and the control sequence names are shared with the other contrasts
+static int RunContrast(const RRA_CONTEXT *context, const ITEM_ARENA *items, const GROUP_STRUCT *groups, int groupNum,
+					   const LIST_STRUCT *lists, int listNum, double maxPercentile, const NAME_POOL *itemNames,
+					   const CONTRAST_MATRIX *matrix, int c, GROUP_STRUCT *contrastGroups, int *contrastOrder)
+{
+	int i, flag;
+	RRA_CONTEXT contrastContext = *context;
+	ITEM_ARENA contrastItems = *items;
+	LIST_STRUCT *contrastLists = new LIST_STRUCT[listNum];
+	GROUP_STRUCT *cgroups = contrastGroups+(long)c*groupNum;
+	
+	contrastItems.value = matrix->values+(long)c*items->itemNum;
+	contrastItems.percentile = new double[items->itemNum];
+	for (i=0;i<listNum;i++){
+		contrastLists[i] = lists[i];
+		contrastLists[i].items = new int[lists[i].itemNum+1];
+		memcpy(contrastLists[i].items, lists[i].items, lists[i].itemNum*sizeof(int));
+	}
+	memcpy(cgroups, groups, groupNum*sizeof(GROUP_STRUCT));
+	
+	flag = RunRRA(&contrastContext, &contrastItems, cgroups, groupNum, contrastLists, listNum, maxPercentile, itemNames,
+				  contrastOrder+(long)c*groupNum);
+	
+	for (i=0;i<listNum;i++){
+		delete []contrastLists[i].items;
+	}
+	delete []contrastLists;
+	delete []contrastItems.percentile;
+	
+	return flag;
+}
+
+//Rank aggregation of every contrast of a matrix input over one item arena, group and list table
+int RunMatrixRRA(RRA_CONTEXT *context, ITEM_ARENA *items, const GROUP_STRUCT *groups, int groupNum, const LIST_STRUCT *lists,
+				 int listNum, double maxPercentile, const NAME_POOL *itemNames, const CONTRAST_MATRIX *matrix,
+				 GROUP_STRUCT *contrastGroups, int *contrastOrder)
+{
+	int c, flag;
+	int failNum = 0;
+	int contrastNum = matrix->contrastNum;
+	NULL_STORE localStore;
+	NULL_STORE *savedStore = context->nullStore;
+	
+	//all contrasts have the same group sizes, so the null lo-values of the first one serve the others
+	if (savedStore==NULL){
+		InitNullStore(&localStore);
+		context->nullStore = &localStore;
+	}
+	
+	cerr<<"Contrast "<<GetName(&matrix->contrastNames, 0)<<"...\n";
+	flag = RunContrast(context, items, groups, groupNum, lists, listNum, maxPercentile, itemNames, matrix, 0,
+					   contrastGroups, contrastOrder);
+	
+	if (flag>0){
+		vector<int> contrastFlag(contrastNum, 1);
+		auto runOne = [&](int k, int threadId){
+			cerr<<"Contrast "<<GetName(&matrix->contrastNames, k+1)<<"...\n";
+			contrastFlag[k+1] = RunContrast(context, items, groups, groupNum, lists, listNum, maxPercentile, itemNames, matrix,
+											k+1, contrastGroups, contrastOrder);
+		};
+		if ((ThreadPoolSize()>1)&&(contrastNum-1>=ThreadPoolSize())){
+			ParallelFor(contrastNum-1, runOne);
+		}else{
+			for (c=0;c<contrastNum-1;c++){
+				runOne(c, 0);
+			}
+		}
+		for (c=1;c<contrastNum;c++){
+			if (contrastFlag[c]<=0){
+				failNum++;
+			}
+		}
+		flag = (failNum==0)? 1 : -1;
+	}
+	
+	if (savedStore==NULL){
+		FreeNullStore(&localStore);
+		context->nullStore = NULL;
 	}
 	
-	inputFileName[0] = 0;
-	outputFileName[0] = 0;
-	maxPercentile = 0.1;
+	return flag;
+}
+
+#ifndef RRA_LIBRARY
+//Parse the options of one job from argv[0..argc-1], on top of the options already in job. threadNum and batchFileName
+//receive --threads and --batch, which only the command line may give; pass NULL to reject them.
+//Return 1 if success, -1 if failure
+int ParseJobOptions(int argc, const char * argv[], RRA_JOB *job, int *threadNum, const char **batchFileName)
+{
+	int i;
+	RRA_CONTEXT *context = &job->context;
 	
-	for (i=2;i<argc;i++)
+	for (i=1;i<argc;i++)
 	{
 		if (strcmp(argv[i-1], "-i")==0){
-			strcpy(inputFileName, argv[i]);
+			job->inputFileName = argv[i];
 		}
 		if (strcmp(argv[i-1], "-o")==0){
-			strcpy(outputFileName, argv[i]);
+			job->outputFileName = argv[i];
 		}
 		if (strcmp(argv[i-1], "-p")==0){
-			maxPercentile = atof(argv[i]);
+			job->maxPercentile = atof(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--threads")==0){
+			if (threadNum==NULL){
+				cerr<<"Error: --threads can only be given on the command line.\n";
+				return -1;
+			}
+			*threadNum = atoi(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--batch")==0){
+			if (batchFileName==NULL){
+				cerr<<"Error: --batch can only be given on the command line.\n";
+				return -1;
+			}
+			*batchFileName = argv[i];
+		}
+		if (strcmp(argv[i-1], "--lovalue-method")==0){
+			if (strcmp(argv[i], "orderstat")==0){
+				context->loValueMethod = LOVALUE_ORDERSTAT;
+			}else if (strcmp(argv[i], "betain")==0){
+				context->loValueMethod = LOVALUE_BETAIN;
+			}else{
+				cerr<<"Error: unknown lo-value method "<<argv[i]<<". Use orderstat or betain.\n";
+				return -1;
+			}
+		}
+		if (strcmp(argv[i-1], "--rng")==0){
+			if (strcmp(argv[i], "philox")==0){
+				context->rngMethod = RNG_PHILOX;
+			}else if (strcmp(argv[i], "lehmer")==0){
+				context->rngMethod = RNG_LEHMER;
+			}else{
+				cerr<<"Error: unknown random generator "<<argv[i]<<". Use philox or lehmer.\n";
+				return -1;
+			}
+		}
+		if (strcmp(argv[i-1], "--pvalue-method")==0){
+			if (strcmp(argv[i], "permutation")==0){
+				context->pvalueMethod = PVALUE_PERMUTATION;
+			}else if (strcmp(argv[i], "exact")==0){
+				context->pvalueMethod = PVALUE_EXACT;
+			}else{
+				cerr<<"Error: unknown p-value method "<<argv[i]<<". Use permutation or exact.\n";
+				return -1;
+			}
+		}
+		if (strcmp(argv[i-1], "--min-pvalue")==0){
+			context->minPValue = atof(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--pvalue-error")==0){
+			context->pvalueRelError = atof(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--null-cache")==0){
+			context->nullCacheDir = argv[i];
 		}
 		if (strcmp(argv[i-1], "--control")==0){
-       UseControlSeq=true;
-       // load control sequences
-       loadControlSeq(argv[i]);
-    }
+			job->controlFileName = argv[i];
+		}
+		if (strcmp(argv[i-1], "--p-pos")==0){
+			job->posMaxPercentile = atof(argv[i]);
+		}
+		if (strcmp(argv[i-1], "--sort-criteria")==0){
+			if (strcmp(argv[i], "neg")==0){
+				job->sortByPos = false;
+			}else if (strcmp(argv[i], "pos")==0){
+				job->sortByPos = true;
+			}else{
+				cerr<<"Error: unknown sort criteria "<<argv[i]<<". Use neg or pos.\n";
+				return -1;
+			}
+		}
+	}
+	
+	//--dual-tail and --matrix take no value
+	for (i=0;i<argc;i++)
+	{
+		if (strcmp(argv[i], "--dual-tail")==0){
+			job->dualTail = true;
+		}
+		if (strcmp(argv[i], "--matrix")==0){
+			job->matrix = true;
+		}
 	}
 	
-	if ((inputFileName[0]==0)||(outputFileName[0]==0))
+	return 1;
+}
+
+//Check the options of a job. Return 1 if success, -1 if failure
+int CheckJobOptions(const RRA_JOB *job)
+{
+	if ((job->inputFileName==NULL)||(job->outputFileName==NULL))
 	{
 		cerr<<"Error: input file or output file name not set.\n";
-		PrintCommandUsage(argv[0]);
 		return -1;
 	}
 	
-	if ((maxPercentile>1.0)||(maxPercentile<0.0))
+	if ((job->maxPercentile>1.0)||(job->maxPercentile<0.0))
 	{
 		cerr<<("Error: maxPercentile should be within 0.0 and 1.0\n");
 		return -1;
 	}
 	
-	groups = (GROUP_STRUCT *)malloc(MAX_GROUP_NUM*sizeof(GROUP_STRUCT));
-	lists = (LIST_STRUCT *)malloc(MAX_LIST_NUM*sizeof(LIST_STRUCT));
-	assert(groups!=NULL);
-	assert(lists!=NULL);
+	if (job->dualTail&&(job->posMaxPercentile>1.0))
+	{
+		cerr<<("Error: --p-pos should be within 0.0 and 1.0\n");
+		return -1;
+	}
+	
+	if (job->dualTail&&job->matrix)
+	{
+		cerr<<("Error: --dual-tail and --matrix cannot be used together\n");
+		return -1;
+	}
+	
+	if ((job->context.minPValue<0.0)||(job->context.minPValue>=1.0)||(job->context.pvalueRelError<0.0))
+	{
+		cerr<<("Error: --min-pvalue should be within 0.0 and 1.0, and --pvalue-error positive\n");
+		return -1;
+	}
+	
+	return 1;
+}
+
+//Read the input file of a job, run RRA and save the group summary. Return 1 if success, -1 if failure
+int RunJob(RRA_JOB *job)
+{
+	int i,flag;
+	GROUP_STRUCT *groups=NULL;
+	int *groupOrder=NULL;
+	GROUP_STRUCT *posGroups=NULL;
+	int *posOrder=NULL;
+	GROUP_STRUCT *contrastGroups=NULL;
+	int *contrastOrder=NULL;
+	int groupNum;
+	LIST_STRUCT *lists=NULL;
+	int listNum;
+	NAME_POOL itemNames, groupNames, listNames;
+	ITEM_ARENA items;
+	CONTRAST_MATRIX matrix;
+	
+	// load control sequences
+	if ((job->controlFileName!=NULL)&&(loadControlSeq(&job->context, job->controlFileName)<0)){
+		FreeRraContext(&job->context);
+		return -1;
+	}
+	
+	InitNamePool(&itemNames);
+	InitNamePool(&groupNames);
+	InitNamePool(&listNames);
 	
 	printf("Reading input file...\n");
 	
-	flag = ReadFile(inputFileName, groups, MAX_GROUP_NUM, &groupNum, lists, MAX_LIST_NUM, &listNum);
+	if (job->matrix){
+		flag = ReadMatrixFile(job->inputFileName, &items, &groups, &groupNum, &lists, &listNum, &itemNames, &groupNames, &listNames,
+							  &matrix);
+	}else{
+		flag = ReadFile(job->inputFileName, &items, &groups, &groupNum, &lists, &listNum, &itemNames, &groupNames, &listNames);
+	}
 	
 	if (flag<=0){
 	  cerr<<"\nError: reading ranking file ...\n";
+		FreeNamePool(&itemNames);
+		FreeNamePool(&groupNames);
+		FreeNamePool(&listNames);
+		FreeRraContext(&job->context);
 		return -1;
 	}
 	
-	cerr<<("Computing lo-values for each group...\n");
+	groupOrder = new int[groupNum];
 	
-	if (ProcessGroups(groups, groupNum, lists, listNum, maxPercentile)<=0)
-  {
-		cerr<<("\nError: processing groups failed.\n");
-		return -1;
+	if (job->matrix){
+		contrastGroups = new GROUP_STRUCT[(long)groupNum*matrix.contrastNum];
+		contrastOrder = new int[(long)groupNum*matrix.contrastNum];
+		flag = RunMatrixRRA(&job->context, &items, groups, groupNum, lists, listNum, job->maxPercentile, &itemNames, &matrix,
+							contrastGroups, contrastOrder);
+	}else if (job->dualTail){
+		posGroups = new GROUP_STRUCT[groupNum];
+		posOrder = new int[groupNum];
+		flag = RunDualTailRRA(&job->context, &items, groups, posGroups, groupNum, lists, listNum, job->maxPercentile,
+							  (job->posMaxPercentile<0.0)? job->maxPercentile : job->posMaxPercentile, &itemNames, groupOrder, posOrder);
+	}else{
+		flag = RunRRA(&job->context, &items, groups, groupNum, lists, listNum, job->maxPercentile, &itemNames, groupOrder);
+	}
+	
+	if (flag>0)
+	{
+		cerr<<("Saving to output file...");
+		
+		if (job->matrix){
+			flag = SaveMatrixSummary(job->outputFileName, contrastGroups, contrastOrder, groupNum, &groupNames, &matrix);
+		}else if (job->dualTail){
+			flag = SaveDualTailSummary(job->outputFileName, groups, groupOrder, posGroups, posOrder, groupNum, &groupNames,
+									   job->sortByPos);
+		}else{
+			flag = SaveGroupInfo(job->outputFileName, groups, groupOrder, groupNum, &groupNames);
+		}
+		if (flag<=0)
+		{
+			cerr<<("\nError: saving output file failed.\n");
+		}else{
+			cerr<<("RRA completed.\n");
+		}
 	}
 	
-	cerr<<("Computing false discovery rate...\n");
+	free(groups);
+	delete []groupOrder;
+	delete []posGroups;
+	delete []posOrder;
+	delete []contrastGroups;
+	delete []contrastOrder;
+	if (job->matrix){
+		FreeContrastMatrix(&matrix);
+	}
 	
-	if (ComputeFDR(groups, groupNum, maxPercentile, RAND_PASS_NUM*groupNum)<=0)
+	for (i=0;i<listNum;i++)
 	{
-		cerr<<("\nError: computing FDR failed.\n");
+		free(lists[i].items);
+	}
+	free(lists);
+	FreeItemArena(&items);
+	FreeNamePool(&itemNames);
+	FreeNamePool(&groupNames);
+	FreeNamePool(&listNames);
+	FreeRraContext(&job->context);
+	
+	return (flag>0)? 1 : -1;
+}
+
+//Run the jobs of a manifest: one job per line, with the options of the command line; empty lines and lines starting
+//with # are skipped. The options of defaultJob apply unless a line overrides them. With at least as many jobs as
+//threads, the jobs are spread over the worker pool and each runs on one thread; otherwise they run one after the other,
+//each using the whole pool. Null lo-values are shared between jobs with the same lo-value method, random generator and
+//percentile cutoff. A failing job does not stop the others. Return 1 if every job succeeded, -1 otherwise
+int RunBatch(const char *batchFileName, const RRA_JOB *defaultJob)
+{
+	ifstream fh;
+	string oneline;
+	vector<vector<string> > jobWords;
+	vector<RRA_JOB> jobs;
+	vector<int> jobFlag;
+	NULL_STORE nullStore;
+	int i, k;
+	int failNum = 0;
+	
+	fh.open(batchFileName);
+	if (!fh.is_open()){
+		cerr<<"Error opening "<<batchFileName<<endl;
 		return -1;
 	}
+	while (getline(fh, oneline)){
+		istringstream line(oneline);
+		vector<string> words;
+		string word;
+		
+		while (line>>word){
+			words.push_back(word);
+		}
+		if (words.empty()||(words[0][0]=='#')){
+			continue;
+		}
+		jobWords.push_back(words);
+	}
+	fh.close();
+	
+	//the option strings stay in jobWords while the jobs run
+	jobs.resize(jobWords.size());
+	for (k=0;k<(int)jobWords.size();k++){
+		vector<const char *> argv(jobWords[k].size());
+		
+		for (i=0;i<(int)jobWords[k].size();i++){
+			argv[i] = jobWords[k][i].c_str();
+		}
+		jobs[k] = *defaultJob;
+		if ((ParseJobOptions((int)argv.size(), argv.data(), &jobs[k], NULL, NULL)<=0)||(CheckJobOptions(&jobs[k])<=0)){
+			cerr<<"Error: job "<<k+1<<" of the batch file "<<batchFileName<<" is not valid.\n";
+			return -1;
+		}
+	}
+	
+	InitNullStore(&nullStore);
+	for (k=0;k<(int)jobs.size();k++){
+		jobs[k].context.nullStore = &nullStore;
+	}
+	jobFlag.resize(jobs.size());
+	
+	auto runOne = [&jobs, &jobFlag](int k, int threadId){
+		printf("Batch job %d/%d: %s\n", k+1, (int)jobs.size(), jobs[k].inputFileName);
+		jobFlag[k] = RunJob(&jobs[k]);
+		if (jobFlag[k]<=0){
+			cerr<<"Error: batch job "<<k+1<<" ("<<jobs[k].inputFileName<<") failed.\n";
+		}
+	};
+	if ((ThreadPoolSize()>1)&&((int)jobs.size()>=ThreadPoolSize())){
+		ParallelFor((int)jobs.size(), runOne);
+	}else{
+		for (k=0;k<(int)jobs.size();k++){
+			runOne(k, 0);
+		}
+	}
+	
+	for (k=0;k<(int)jobs.size();k++){
+		if (jobFlag[k]<=0){
+			failNum++;
+		}
+	}
+	cout<<"Batch completed: "<<(int)jobs.size()-failNum<<" of "<<jobs.size()<<" jobs succeeded."<<endl;
+	FreeNullStore(&nullStore);
 	
-	cerr<<("Saving to output file...");
+	return (failNum==0)? 1 : -1;
+}
+
+int main (int argc, const char * argv[]) {
+	int flag;
+	int threadNum;
+	const char *batchFileName;
+	RRA_JOB job;
 	
-	if (SaveGroupInfo(outputFileName, groups, groupNum)<=0)
+	//Parse the command line
+	if (argc == 1)
 	{
-		cerr<<("\nError: saving output file failed.\n");
-		return -1;
+		PrintCommandUsage(argv[0]);
+		return 0;
 	}
 	
-	cerr<<("RRA completed.\n");
+	job.inputFileName = NULL;
+	job.outputFileName = NULL;
+	job.controlFileName = NULL;
+	job.maxPercentile = 0.1;
+	job.dualTail = false;
+	job.posMaxPercentile = -1.0;
+	job.sortByPos = false;
+	job.matrix = false;
+	threadNum = 0;
+	batchFileName = NULL;
+	InitRraContext(&job.context);
 	
-  for(i=0;i<groupNum;i++)
-    delete[] groups[i].items;
-	free(groups);
+	if (ParseJobOptions(argc-1, argv+1, &job, &threadNum, &batchFileName)<=0){
+		return -1;
+	}
 	
-	for (i=0;i<listNum;i++)
+	if (batchFileName==NULL)
 	{
-		delete[] lists[i].values;
+		if (CheckJobOptions(&job)<=0){
+			if ((job.inputFileName==NULL)||(job.outputFileName==NULL)){
+				PrintCommandUsage(argv[0]);
+			}
+			return -1;
+		}
 	}
-	free(lists);
-  if(UseControlSeq){
-    delete[] ControlSeqPercentile;
-  }
-  if(nLovarray>0){
-    delete []tmpLovarray;
-  }
-
-	return 0;
+	
+	InitThreadPool(threadNum);
+	
+	if (batchFileName!=NULL){
+		flag = RunBatch(batchFileName, &job);
+	}else{
+		flag = RunJob(&job);
+	}
+	
+	FreeThreadPool();
+	
+	return (flag>0)? 0 : -1;
 
 }
 
@@ -210,29 +804,105 @@ void PrintCommandUsage(const char *command)
 	printf("-o <output file>. Format: <group id> <number of items in the group> <lo-value> <false discovery rate>\n");
 	printf("-p <maximum percentile>. RRA only consider the items with percentile smaller than this parameter. Default=0.1\n");
 	printf("--control <control_sgrna list>. A list of control sgRNA names.\n");
+	printf("--dual-tail. Rank the values in both directions: negative selection as usual, and positive selection on the negated values, reusing the input and the null lo-values. -o receives the merged summary <id> <num> <lo.neg> <p.neg> <fdr.neg> <rank.neg> <goodsgrna.neg> <lo.pos> <p.pos> <fdr.pos> <rank.pos> <goodsgrna.pos>\n");
+	printf("--p-pos <maximum percentile>. With --dual-tail, the maximum percentile of the positive selection. Default: the -p value\n");
+	printf("--sort-criteria <neg|pos>. With --dual-tail, the direction the merged summary is sorted by. Default=neg\n");
+	printf("--matrix. The input has one value column per contrast, named by the header: <item id> <group id> <list id> <value of contrast 1> ... <value of contrast K>; columns named prob and chosen are shared by all contrasts. The groups are built once and -o receives <group id> <number of items in the group> followed by <lo-value> <p> <FDR> <goodsgrna> of each contrast\n");
+	printf("--batch <batch file>. Run one job per line of this file, each line holding the -i, -o, -p, --control and other options of a job (not --threads); options given on the command line are the defaults of every job. Null lo-values are shared between the jobs.\n");
+	printf("--threads <number of threads>. Default: all available cores.\n");
+	printf("--min-pvalue <p-value>. Add random passes in batches until p-values are resolved down to this value; smaller p-values are only bounded by it. Default: the resolution of %d passes\n", RAND_PASS_NUM);
+	printf("--pvalue-error <relative error>. With adaptive passes, relative standard error a p-value is resolved to. Default=%g if --min-pvalue is given, otherwise passes are not adaptive\n", ADAPTIVE_REL_ERROR);
+	printf("--null-cache <directory>. Reuse null lo-values of earlier runs stored in this directory, and store new ones there.\n");
+	printf("--pvalue-method <permutation|exact>. exact computes p-values from the exact null distribution of the lo-value instead of random passes; runs with control sgRNAs or sgRNA probabilities always use permutation. Default=permutation\n");
+	printf("--rng <philox|lehmer>. Random generator of the null simulation; lehmer draws the null group by group with the Lehmer generator, as earlier releases did, and reproduces their p-values and FDRs; only groups with exactly equal lo-values may be listed in a different order. Default=philox\n");
+	printf("--lovalue-method <orderstat|betain>. Beta CDF backend of the lo-values; betain is the slower reference. With a <probability> column, the lo-value of a group is its expectation over sgRNAs selected with these probabilities, an empty selection scoring 1; earlier releases scored it 0, so weighted lo-values, p-values and FDRs are not comparable to theirs. Default=orderstat\n");
 	printf("example:\n");
 	printf("%s -i input.txt -o output.txt -p 0.1 \n", command);
+	printf("%s --batch jobs.txt --threads 8\n", command);
 	
 }
+#endif
 
 
 
 
+//Position in the sorted array a[0..n-1] nearest to value, given first = the number of elements smaller than value.
+//Same result as bTreeSearchingF(value, a, 0, n-1)
+static inline int NearestSorted(double value, const INDEXED_FLOAT *a, int n, int first)
+{
+	if (first==0){
+		return 0;
+	}
+	if (first>=n){
+		return n-1;
+	}
+	if (a[first].value==value){
+		return first;
+	}
+	return (fabs(a[first].value-value)>fabs(a[first-1].value-value))? first-1 : first;
+}
+
+//Sort the items of a list by value and assign each item its percentile in the list.
+//Values within 1e-9 of each other are ties and share the average of their ranks; the two rank bounds
+//are found by pointers that only move forward, so the whole list is ranked in one linear sweep
+void AssignListPercentiles(ITEM_ARENA *items, LIST_STRUCT *list)
+{
+	int j,s,e;
+	int n = list->itemNum;
+	int first1 = 0, first2 = 0;
+	int index1, index2;
+	INDEXED_FLOAT *tmpIndexed;
+	double percentile;
+	
+	if (n<=0){
+		return;
+	}
+	tmpIndexed = new INDEXED_FLOAT[n];
+	for (j=0;j<n;j++){
+		tmpIndexed[j].value = items->value[list->items[j]];
+		tmpIndexed[j].index = list->items[j];
+	}
+	SortIndexedArray(tmpIndexed, n);
+	
+	for (s=0;s<n;s=e+1){
+		double low = tmpIndexed[s].value-0.000000001;
+		double high = tmpIndexed[s].value+0.000000001;
+		
+		e = s;
+		while (e+1<n && tmpIndexed[e+1].value==tmpIndexed[s].value){
+			e++;
+		}
+		while (first1<n && tmpIndexed[first1].value<low) first1++;
+		while (first2<n && tmpIndexed[first2].value<high) first2++;
+		index1 = NearestSorted(low, tmpIndexed, n, first1);
+		index2 = NearestSorted(high, tmpIndexed, n, first2);
+		
+		percentile = ((double)index1+index2+1)/(n*2);
+		for (j=s;j<=e;j++){
+			items->percentile[tmpIndexed[j].index] = percentile;
+		}
+	}
+	for (j=0;j<n;j++){
+		list->items[j] = tmpIndexed[j].index;
+	}
+	delete[] tmpIndexed;
+}
+
 //Process groups by computing percentiles for each item and lo-values for each group
 //groups: genes
 //lists: a set of different groups. Comparison will be performed on individual list
-int ProcessGroups(GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, double maxPercentile)
+int ProcessGroups(RRA_CONTEXT *context, ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum,
+				  double maxPercentile)
 {
-	int i,j;
-	int listIndex, index1, index2;
+	int i,k;
 	int maxItemPerGroup;
 	double *tmpF;
 	double *tmpProb;
-	bool isallone; // check if all the probs are 1; if yes, do not use accumulation of prob. scores
+	bool *isWeighted;
+	int threadNum = ThreadPoolSize();
+	LOVALUE_SCRATCH *scratch;
 	
 	maxItemPerGroup = 0;
-
-  PRINT_DEBUG=1;
 	
 	for (i=0;i<groupNum;i++){
 		if (groups[i].itemNum>maxItemPerGroup){
@@ -242,91 +912,147 @@ int ProcessGroups(GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int li
 	
 	assert(maxItemPerGroup>0);
 	
-	tmpF = new double[maxItemPerGroup];
-	tmpProb = new double [maxItemPerGroup];
-	
-	for (i=0;i<listNum;i++){
-		QuicksortF(lists[i].values, 0, lists[i].itemNum-1);
+	tmpF = new double[(long)maxItemPerGroup*threadNum];
+	tmpProb = new double [(long)maxItemPerGroup*threadNum];
+	isWeighted = new bool[groupNum];
+	scratch = new LOVALUE_SCRATCH[threadNum];
+	for (i=0;i<threadNum;i++){
+		InitLoValueScratch(scratch+i);
 	}
 	
-	for (i=0;i<groupNum;i++){
-		//Compute percentile for each item
+	//Compute percentile for each item: sort each list once and assign ranks, lists in parallel
+	ParallelFor(listNum, [&](int listIndex, int threadId){
+		AssignListPercentiles(items, lists+listIndex);
+	});
+	//items listed under several groups take the percentile of their first copy
+	for (k=0;k<items->itemNum;k++){
+		if (items->origin[k]!=k){
+			items->percentile[k] = items->percentile[items->origin[k]];
+		}
+	}
+	//percentiles of the control sequences for the random passes: in ascending order, or with --rng lehmer in the
+	//order of the control names, which earlier releases drew from
+	if (context->useControlSeq){
+		int c, n = 0;
+		const NAME_POOL *controlNames = &context->controlSeqNames;
+		vector<int> controls;
 		
-		isallone=true;
+		for (c=0;c<(int)controlNames->nameNum;c++){
+			if (context->controlSeqItem[c]>=0){
+				controls.push_back(c);
+			}
+		}
+		if (context->rngMethod==RNG_LEHMER){
+			sort(controls.begin(), controls.end(), [controlNames](int a, int b){
+				return strcmp(GetName(controlNames, a), GetName(controlNames, b))<0;
+			});
+		}
+		for (c=0;c<(int)controls.size();c++){
+			context->controlSeqPercentile[n++] = items->percentile[context->controlSeqItem[controls[c]]];
+		}
+		if (context->rngMethod!=RNG_LEHMER){
+			SortF(context->controlSeqPercentile, n);
+		}
+	}
+	
+	//Compute the lo-value of each group, groups in parallel with the work space of each thread. This loop has the
+	//workers even while the null is simulated, which matters for pathway runs with few, large groups
+	ParallelFor(groupNum, [&](int i, int threadId){
+		double *groupF = tmpF+(long)maxItemPerGroup*threadId;
+		double *groupProb = tmpProb+(long)maxItemPerGroup*threadId;
+		bool isallone=true; // check if all the probs are 1; if yes, do not use accumulation of prob. scores
+		int k;
     int validsgs=0;
-		for (j=0;j<groups[i].itemNum;j++){
-      if(groups[i].items[j].isChosen==0) continue;
-			listIndex = groups[i].items[j].listIndex;
-			
-			index1 = bTreeSearchingF(groups[i].items[j].value-0.000000001, lists[listIndex].values, 0, lists[listIndex].itemNum-1);
-			index2 = bTreeSearchingF(groups[i].items[j].value+0.000000001, lists[listIndex].values, 0, lists[listIndex].itemNum-1);
-			
-			groups[i].items[j].percentile = ((double)index1+index2+1)/(lists[listIndex].itemNum*2);
-			tmpF[validsgs] = groups[i].items[j].percentile;
-			tmpProb[validsgs]=groups[i].items[j].prob;
-			if(tmpProb[validsgs]!=1.0){
+		
+		for (k=groups[i].itemStart;k<groups[i].itemStart+groups[i].itemNum;k++){
+      if(items->isChosen[k]==0) continue;
+			groupF[validsgs] = items->percentile[k];
+			groupProb[validsgs]=items->prob[k];
+			if(groupProb[validsgs]!=1.0){
 				isallone=false;
 			}
-      // save for control sequences
-      if(UseControlSeq){
-        string sgname(groups[i].items[j].name);
-        if(ControlSeqMap.count(sgname)>0){
-          int sgindex=ControlSeqMap[sgname];
-          ControlSeqPercentile[sgindex]=tmpF[validsgs];
-        }
-      }//end if
       validsgs++;
-		}// end j
+		}// end k
     if(validsgs<=1){
       isallone=true;
     }
-    //printf("Gene: %s\n",groups[i].name);
 		if(isallone){
-			ComputeLoValue(tmpF, validsgs, groups[i].loValue, maxPercentile, groups[i].goodsgrnas);
+			ComputeLoValue(context, groupF, validsgs, groups[i].loValue, maxPercentile, groups[i].goodsgrnas, scratch+threadId);
 		}
 		else{
-			ComputeLoValue_Prob(tmpF, validsgs, groups[i].loValue, maxPercentile, tmpProb,groups[i].goodsgrnas);
+			ComputeLoValue_Prob(context, groupF, validsgs, groups[i].loValue, maxPercentile, groupProb,groups[i].goodsgrnas, scratch+threadId);
 		}
+    isWeighted[i]=!isallone;
     groups[i].isbad=0;
-	}//end i loop
-
-	delete[] tmpF;
-	delete[] tmpProb;
-  //check if all control sequences are properly assigned a value
-  if(UseControlSeq){
-    for(map<string,int>::iterator mit = ControlSeqMap.begin(); mit != ControlSeqMap.end(); mit++){
-      if(ControlSeqPercentile[mit->second]<0){
-        cerr<<"Warning: sgRNA "<<mit->first<<" not found in the ranked list. \n";
-        //ControlSeqPercentile[mit->second]=0.5;
-      }
-    }
-  }//end UseControlSeq
+	});
+	
+	//debug output of the probability-weighted groups, in group order
+	for (i=0;(i<groupNum)&&context->printDebug;i++){
+		if (!isWeighted[i]){
+			continue;
+		}
+		printf("probs:");
+		for (k=groups[i].itemStart;k<groups[i].itemStart+groups[i].itemNum;k++){
+			if(items->isChosen[k]!=0) printf("%f,",items->prob[k]);
+		}
+		printf("\n");
+		printf("total: %f\n",groups[i].loValue);
+	}
+
+	delete[] tmpF;
+	delete[] tmpProb;
+	delete[] isWeighted;
+	for (i=0;i<threadNum;i++){
+		FreeLoValueScratch(scratch+i);
+	}
+	delete[] scratch;
 	
 	return 1;
 }
 
+//Set up the work space of ComputeLoValue and ComputeLoValue_Prob; buffers grow on demand
+void InitLoValueScratch(LOVALUE_SCRATCH *scratch)
+{
+	scratch->lovarray = NULL;
+	scratch->nLovarray = 0;
+	scratch->probLovarray = NULL;
+	scratch->nProbLovarray = 0;
+}
+
+//Release the work space of ComputeLoValue and ComputeLoValue_Prob
+void FreeLoValueScratch(LOVALUE_SCRATCH *scratch)
+{
+	delete[] scratch->lovarray;
+	delete[] scratch->probLovarray;
+	InitLoValueScratch(scratch);
+}
+
 //Compute lo-value based on an array of percentiles. Return 1 if success, 0 if failure
-int ComputeLoValue(double *percentiles,     //array of percentiles
+int ComputeLoValue(const RRA_CONTEXT *context, //options of the analysis
+				   double *percentiles,     //array of percentiles
 				   int num,                 //length of array
 				   double &loValue,         //pointer to the output lo-value
 				   double maxPercentile,   //maximum percentile, computation stops when maximum percentile is reached
-           int &goodsgrna){   // the number of " good" sgRNAs
-	int i;
-	double *tmpArray;
-	double tmpLoValue, tmpF;
+           int &goodsgrna,   // the number of " good" sgRNAs
+				   LOVALUE_SCRATCH *scratch){ //work space of the calling thread
+	int i, rankNum;
+	double *tmpArray, *cdf;
+	double tmpLoValue;
 	
 	if(num==0){
     loValue=1.00;
     goodsgrna=0;
     return 0;
   }
-  if(num>nLovarray){
-    delete[] tmpLovarray;
-    tmpLovarray=new double[num];
-    nLovarray=num;
+  //the second half holds the order-statistic CDFs
+  if(num>scratch->nLovarray){
+    delete[] scratch->lovarray;
+    scratch->lovarray=new double[2*num];
+    scratch->nLovarray=num;
   }
 	//tmpArray = (double *)malloc(num*sizeof(double));
-  tmpArray=tmpLovarray;
+  tmpArray=scratch->lovarray;
+  cdf=scratch->lovarray+num;
 	
 	if (!tmpArray){
 		return -1;
@@ -339,19 +1065,23 @@ int ComputeLoValue(double *percentiles,     //array of percentiles
 	tmpLoValue = 1.0;
   goodsgrna=0;
 	
-	for (i=0;i<num;i++){
-		// if ((tmpArray[i]>maxPercentile)&&(i>0)) //only calculate the value if at least 1 percentile is smaller than the cutoff
-		if ((tmpArray[i]>maxPercentile)){
-      if(i==0){}
-      else{
-			  break;
-      }
-		}else{
-      goodsgrna++;
+	//only the ranks within the cutoff count, but the first rank is always computed
+	while ((goodsgrna<num)&&(tmpArray[goodsgrna]<=maxPercentile)){
+    goodsgrna++;
+  }
+  rankNum=(goodsgrna>0)?goodsgrna:1;
+  
+  if(context->loValueMethod==LOVALUE_BETAIN){
+    for (i=0;i<rankNum;i++){
+      cdf[i] = BetaIntegerCdf(i+1,num-i,tmpArray[i]);
     }
-		tmpF = BetaNoncentralCdf((double)(i+1),(double)(num-i),0.0,tmpArray[i],CDF_MAX_ERROR);
-		if (tmpF<tmpLoValue){
-			tmpLoValue = tmpF;
+  }else{
+    OrderStatisticCdf(tmpArray,num,rankNum,cdf);
+  }
+	
+	for (i=0;i<rankNum;i++){
+		if (cdf[i]<tmpLoValue){
+			tmpLoValue = cdf[i];
 		}
 	}
 	
@@ -363,47 +1093,98 @@ int ComputeLoValue(double *percentiles,     //array of percentiles
 	
 }
 
+//P(lo-value>t, with exactly c sgRNAs selected of which at least one within the cutoff), over sgRNAs selected independently
+//with probability prob. Only the goodNum sgRNAs within the cutoff, sorted by percentile, are followed: their ranks are the
+//ones that count, and cdf[k*w+r], w=min(c,goodNum), is the CDF of rank r+1 (of c) at the k-th of them. The other sgRNAs
+//only add to c; badCount[b] is the probability that b of them, out of badNum, are selected. O(goodNum*w)
+double ProbLoValueAbove(double t, const double *prob, const double *cdf, int goodNum, int c, const double *badCount,
+						int badNum, double *f)
+{
+	int k, r, top;
+	int w = (c<goodNum)? c : goodNum;
+	double p = 0.0;
+	
+	f[0] = 1.0;
+	for (r=1;r<=w;r++){
+		f[r] = 0.0;
+	}
+	for (k=0;k<goodNum;k++){
+		top = (k+1<w)? k+1 : w;
+		for (r=top;r>0;r--){
+			f[r] = f[r]*(1.0-prob[k]) + ((cdf[k*w+r-1]>t)? f[r-1]*prob[k] : 0.0);
+		}
+		f[0] *= 1.0-prob[k];
+	}
+	for (r=(c-badNum>1)? c-badNum : 1;r<=w;r++){
+		p += f[r]*badCount[c-r];
+	}
+	return p;
+}
+
 //Compute lo-value based on an array of percentiles, by considering the probability of each sgRNAs. 
+//The lo-value is its expectation when each sgRNA is selected independently with its probability; an empty selection
+//scores 1, so the lo-values of weighted groups are not comparable to those of releases before the expectation.
+//Only the ranks within the cutoff count (and the first rank), so with a sgRNAs selected within the cutoff, the sgRNAs beyond
+//it only matter through how many of them are selected:
+//- with none selected within the cutoff, the lo-value is the CDF of the first rank at the first selected sgRNA, and its
+//  expectation is summed directly over that sgRNA and the count of the others, O(num^2);
+//- otherwise, for each selection size c, E[lo; c selected] is the integral over t of g(t)=P(lo>t; c selected), a step
+//  function that only changes at the rank CDFs of the m sgRNAs within the cutoff. It is evaluated by ProbLoValueAbove,
+//  O(m^2), at those breakpoints, so the whole computation is O(num*m^4) and does not grow with the sgRNAs beyond the cutoff.
+//Breakpoints in [a,b] with b<=a*(1+PROB_LOVALUE_TOL) are merged and integrated by the trapezoid rule. As g is non-increasing,
+//the error on [a,b] is at most (b-a)*(g(a)-g(b))/2 <= PROB_LOVALUE_TOL/2*a*P(a<lo<=b; c selected), and a*P(a<lo<=b) is at
+//most E[lo; a<lo<=b]; over disjoint intervals and all c, the relative error of the lo-value is at most PROB_LOVALUE_TOL/2.
 //Return 1 if success, 0 if failure
 //Modified by Wei Li
-int ComputeLoValue_Prob(double *percentiles,     //array of percentiles
+int ComputeLoValue_Prob(const RRA_CONTEXT *context, //options of the analysis
+				   double *percentiles,     //array of percentiles
 				   int num,                 //length of array
 				   double &loValue,         //pointer to the output lo-value
 				   double maxPercentile,   //maximum percentile, computation stops when maximum percentile is reached
 				  double *probValue,
-          int &goodsgrna) {// probability of each prob, must be equal to the size of percentiles
+          int &goodsgrna,// probability of each prob, must be equal to the size of percentiles
+				   LOVALUE_SCRATCH *scratch) {//work space of the calling thread
 
-	int i, pid;
-	double *tmpArray;
-	double tmpLoValue, tmpF;
-
-	// used to calculate cumulative probability
-	int real_i;
-	int c_num;
-	double c_prob;
-	double accuLoValue;
+	int i, j, k, r, b, c, w, m, last, candNum, badNum;
+	double *tmpArray, *tmpProb, *cdf, *cand, *f, *badCount;
+	double tmpF, tmpP, accuLoValue, integral, prev, gPrev, gStart, gEnd, noGood, firstBad;
+	long need;
 
 	if(num==0){
     loValue=1.00;
     goodsgrna=0;
     return 0;
   }
-		
-  if(num>nLovarray){
-    delete[] tmpLovarray;
-    tmpLovarray=new double[num];
-    nLovarray=num;
+  
+  //sorted percentiles and probabilities, the rank CDF table, its breakpoints, the DP row and the count distribution
+  need=2L*num*num+4L*num+2;
+  if(need>scratch->nProbLovarray){
+    delete[] scratch->probLovarray;
+    scratch->probLovarray=new double[need];
+    scratch->nProbLovarray=need;
   }
-	//tmpArray = (double *)malloc(num*sizeof(double));
-  tmpArray=tmpLovarray;
+  tmpArray=scratch->probLovarray;
+  tmpProb=tmpArray+num;
+  cdf=tmpProb+num;
+  cand=cdf+(long)num*num;
+  f=cand+(long)num*num;
+  badCount=f+num+1;
 	
 	if (!tmpArray){
 		return -1;
 	}
 	
-	memcpy(tmpArray, percentiles, num*sizeof(double));
-	
-	QuicksortF(tmpArray, 0, num-1);
+	//sort percentiles, keeping each probability with its percentile
+	for (i=0;i<num;i++){
+		tmpF=percentiles[i];
+		tmpP=probValue[i];
+		for (j=i;(j>0)&&(tmpArray[j-1]>tmpF);j--){
+			tmpArray[j]=tmpArray[j-1];
+			tmpProb[j]=tmpProb[j-1];
+		}
+		tmpArray[j]=tmpF;
+		tmpProb[j]=tmpP;
+	}
   
   goodsgrna=0;
   for (i=0;i<num;i++){
@@ -415,80 +1196,228 @@ int ComputeLoValue_Prob(double *percentiles,     //array of percentiles
       goodsgrna++;
     }
   }
-
-  
-  if(PRINT_DEBUG) printf("probs:");
-  for(i=0;i<num;i++)
-  {
-    if(PRINT_DEBUG) printf("%f,",probValue[i]);
-  }
-  if(PRINT_DEBUG) printf("\n");
+	m=goodsgrna;
+	badNum=num-m;
 	
+	//P(no sgRNA within the cutoff selected)
+	noGood=1.0;
+	for (k=0;k<m;k++){
+		noGood*=1.0-tmpProb[k];
+	}
 	
+	//none selected within the cutoff: the sgRNAs beyond it from the last one down, badCount holding the distribution of
+	//how many of those after sgRNA k are selected; the empty selection scores 1
+	badCount[0]=1.0;
 	accuLoValue=0.0;
-	for (pid=1;pid<(1<<num);pid++)
-	{
-		// decoding the selection
-		tmpLoValue = 1.0;
-		c_num=0;
-		real_i=0;
-		c_prob=1.0;
-		for(i=0;i<num;i++)
-		{
-			if ( (1<<i)&pid )
-			{
-				c_num = c_num +1;
-				c_prob= c_prob*probValue[i];
+	for (k=num-1;k>=m;k--){
+		firstBad=0.0;
+		for (b=0;b<=num-1-k;b++){
+			if (badCount[b]==0.0){
+				continue;
 			}
-			else
-			{
-				c_prob=c_prob*(1.0-probValue[i]);
+			if(context->loValueMethod==LOVALUE_BETAIN){
+				firstBad+=badCount[b]*BetaIntegerCdf(1,b+1,tmpArray[k]);
+			}else{
+				firstBad+=badCount[b]*OrderStatisticCdfAt(0,b+1,tmpArray[k]);
 			}
 		}
-		for (i=0;i<num;i++)
-		{
-			if ( ((1<<i)&pid) ==0)
-			{// if this sgRNA is selected?
-				continue;
+		//sgRNA k selected as the first, or not selected
+		accuLoValue=tmpProb[k]*firstBad+(1.0-tmpProb[k])*accuLoValue;
+		badCount[num-k]=0.0;
+		for (b=num-k;b>0;b--){
+			badCount[b]=badCount[b]*(1.0-tmpProb[k])+badCount[b-1]*tmpProb[k];
+		}
+		badCount[0]*=1.0-tmpProb[k];
+	}
+	//badCount now holds the distribution over all the sgRNAs beyond the cutoff, and badCount[0] is P(none of them selected)
+	accuLoValue=noGood*(accuLoValue+badCount[0]);
+	
+	for (c=1;(c<=num)&&(m>0);c++){
+		//CDF of each rank within the cutoff at each sgRNA within it
+		w=(c<m)? c : m;
+		candNum=0;
+		for (k=0;k<m;k++){
+			for (r=0;(r<w)&&(r<=k);r++){
+				if(context->loValueMethod==LOVALUE_BETAIN){
+					cdf[k*w+r]=BetaIntegerCdf(r+1,c-r,tmpArray[k]);
+				}else{
+					cdf[k*w+r]=OrderStatisticCdfAt(r,c,tmpArray[k]);
+				}
+				cand[candNum++]=cdf[k*w+r];
 			}
-			if ((tmpArray[i]>maxPercentile)&&(i>0))
-			{
-				break;
+		}
+		SortF(cand,candNum);
+		
+		//integrate P(lo>t; c selected) over t in [0,1]; it is non-increasing, so the integration stops once it reaches 0
+		integral=0.0;
+		prev=0.0;
+		gPrev=ProbLoValueAbove(0.0,tmpProb,cdf,m,c,badCount,badNum,f);
+		for (j=0;(j<candNum)&&(gPrev>0.0);j=last+1){
+			last=j;
+			while ((last+1<candNum)&&(cand[last+1]<=cand[j]*(1.0+PROB_LOVALUE_TOL))){
+				last++;
 			}
-			// Beta (a,b, 0, frac)
-			tmpF = BetaNoncentralCdf((double)(real_i+1),(double)(c_num-i),0.0,tmpArray[i],CDF_MAX_ERROR);
-			if (tmpF<tmpLoValue)
-			{
-				tmpLoValue = tmpF;
+			integral+=(cand[j]-prev)*gPrev;
+			gStart=ProbLoValueAbove(cand[j],tmpProb,cdf,m,c,badCount,badNum,f);
+			if (cand[last]>cand[j]){
+				gEnd=ProbLoValueAbove(cand[last],tmpProb,cdf,m,c,badCount,badNum,f);
+				integral+=(cand[last]-cand[j])*(gStart+gEnd)/2;
+			}else{
+				gEnd=gStart;
 			}
-			real_i = real_i + 1;
+			prev=cand[last];
+			gPrev=gEnd;
 		}
-    if(PRINT_DEBUG) printf("pid: %d, prob:%e, score: %f\n",pid,c_prob,tmpLoValue);
-		accuLoValue=accuLoValue+tmpLoValue*c_prob;
+		if (prev<1.0){
+			integral+=(1.0-prev)*gPrev;
+		}
+		accuLoValue+=integral;
 	}
-  if(PRINT_DEBUG) printf("total: %f\n",accuLoValue);
 	
 	loValue = accuLoValue;
 
-	//free(tmpArray);
 	return 0;
 	
 }
 
+//Set up an empty histogram of null values over bucketNum-1 query values
+void InitNullHistogram(NULL_HISTOGRAM *hist, int bucketNum)
+{
+	hist->bucketNum = bucketNum;
+	hist->count = new long long[bucketNum];
+	hist->minValue = new double[bucketNum];
+	hist->maxValue = new double[bucketNum];
+	ClearNullHistogram(hist);
+}
+
+//Remove all null values from a histogram
+void ClearNullHistogram(NULL_HISTOGRAM *hist)
+{
+	int b;
+	
+	for (b=0;b<hist->bucketNum;b++){
+		hist->count[b] = 0;
+		hist->minValue[b] = HUGE_VAL;
+		hist->maxValue[b] = -HUGE_VAL;
+	}
+}
+
+//Release a histogram of null values
+void FreeNullHistogram(NULL_HISTOGRAM *hist)
+{
+	delete []hist->count;
+	delete []hist->minValue;
+	delete []hist->maxValue;
+}
+
+//Count null values, given in ascending order, into the buckets of the query values at or below them
+void AddSortedNullValues(NULL_HISTOGRAM *hist, const double *queries, const double *values, int valueNum)
+{
+	int i, b = 0;
+	int queryNum = hist->bucketNum-1;
+	
+	for (i=0;i<valueNum;i++){
+		while ((b<queryNum)&&(queries[b]<=values[i])){
+			b++;
+		}
+		hist->count[b]++;
+		if (values[i]<hist->minValue[b]){
+			hist->minValue[b] = values[i];
+		}
+		if (values[i]>hist->maxValue[b]){
+			hist->maxValue[b] = values[i];
+		}
+	}
+}
+
+//Add the counts of src to dst
+void MergeNullHistogram(NULL_HISTOGRAM *dst, const NULL_HISTOGRAM *src)
+{
+	int b;
+	
+	for (b=0;b<dst->bucketNum;b++){
+		dst->count[b] += src->count[b];
+		if (src->minValue[b]<dst->minValue[b]){
+			dst->minValue[b] = src->minValue[b];
+		}
+		if (src->maxValue[b]>dst->maxValue[b]){
+			dst->maxValue[b] = src->maxValue[b];
+		}
+	}
+}
+
+//Position of query in the sorted null of nullNum values, as given by bTreeSearchingF, from below, the number of null
+//values below query, pred, the largest of them, and succ, the smallest null value at or above query: below, moved one
+//down when pred is nearer than succ
+double NullPosition(double query, double below, double pred, double succ, double nullNum)
+{
+	if (below<=0){
+		return 0;
+	}
+	if (below>=nullNum){
+		return nullNum-1;
+	}
+	if ((succ==query)||(fabs(succ-query)<=fabs(pred-query))){
+		return below;
+	}
+	return below-1;
+}
+
+//position[k]: the position of query value k in the sorted null of nullNum values, as given by bTreeSearchingF:
+//the number of null values below it, moved one down when the largest of those is nearer than the next null value
+void NullHistogramPositions(const NULL_HISTOGRAM *hist, const double *queries, long long nullNum, long long *position)
+{
+	int k;
+	int queryNum = hist->bucketNum-1;
+	long long below = 0;
+	double pred = -HUGE_VAL, succ;
+	double *nextMin = new double[hist->bucketNum+1];
+	
+	//smallest null value in buckets k..end
+	nextMin[hist->bucketNum] = HUGE_VAL;
+	for (k=hist->bucketNum-1;k>=0;k--){
+		nextMin[k] = (hist->minValue[k]<nextMin[k+1])? hist->minValue[k] : nextMin[k+1];
+	}
+	
+	for (k=0;k<queryNum;k++){
+		below += hist->count[k];
+		if (hist->count[k]>0){
+			pred = hist->maxValue[k];
+		}
+		succ = nextMin[k+1];
+		position[k] = (long long)NullPosition(queries[k], (double)below, pred, succ, (double)nullNum);
+	}
+	delete []nextMin;
+}
 
-//Compute False Discovery Rate based on uniform distribution
-int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int numOfRandPass)
+//p-values from random passes over all groups, pooled into one null distribution. Used when the null lo-value
+//of a group depends on more than its size (per-sgRNA probabilities or control sgRNAs), and with --rng lehmer, whose
+//draws then follow the groups as in earlier releases.
+//The null lo-values are not stored: the values of each pass are sorted and counted into a NULL_HISTOGRAM over the sorted
+//query values lo-value+-1e-9 of the groups, so memory is proportional to the number of groups rather than passes*groups.
+//The p-values are identical to searching the sorted null with bTreeSearchingF.
+//The random passes run in parallel, one pass per task. Pass i draws from its own copy of the random sequence, jumped ahead
+//past the draws of passes 0..i-1, so the null lo-values are the same as a serial run whatever the number of threads.
+//With relError>0, scanPass is an upper bound: passes are added in batches until every p-value is resolved (see PValueResolved)
+int ComputePermutationPValues(const RRA_CONTEXT *context, const ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum,
+							  double maxPercentile, int scanPass, double minPValue, double relError)
 {
-	int i,j,k;
+	int i;
 	double *tmpPercentile;
 	int maxItemNum = 0;
-	int scanPass = numOfRandPass/groupNum+1;
-	double *randLoValue;
-	int randLoValueNum;
+	double *queries, *passLoValues;
+	int queryNum = 2*groupNum;
+	int passNum = FirstPassNum(scanPass, relError);
+	int donePass = 0, unresolvedNum = 0;
+	double randLoValueNum;
+	NULL_HISTOGRAM *histograms, total;
+	long long *position;
+	int threadNum = ThreadPoolSize();
+	long long drawsPerPass = 0;
+	LOVALUE_SCRATCH *scratch;
 
 	//WL
 	double *tmpProb;
-	double isallone;
 	
 	for (i=0;i<groupNum;i++){
 		if (groups[i].itemNum>maxItemNum){
@@ -498,87 +1427,652 @@ int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int num
 	
 	assert(maxItemNum>0);
 	
+	//one draw per chosen item in every pass
+	for (i=0;i<items->itemNum;i++){
+		if (items->isChosen[i]!=0){
+			drawsPerPass++;
+		}
+	}
+	
 	//tmpPercentile = (double *)malloc(maxItemNum*sizeof(double));
 	//tmpProb= (double *)malloc(maxItemNum*sizeof(double));
-  tmpPercentile=new double[maxItemNum];
-  tmpProb=new double[maxItemNum];	
+  tmpPercentile=new double[(long)maxItemNum*threadNum];
+  tmpProb=new double[(long)maxItemNum*threadNum];	
+  scratch=new LOVALUE_SCRATCH[threadNum];
+  for (i=0;i<threadNum;i++){
+    InitLoValueScratch(scratch+i);
+  }
 
-	randLoValueNum = groupNum*scanPass;
-	
-	assert(randLoValueNum>0);
-	
-	//randLoValue = (double *)malloc(randLoValueNum*sizeof(double));
-  randLoValue=new double[randLoValueNum];
-	
-	randLoValueNum = 0;
-	
-	PlantSeeds(123456);
-  
-  PRINT_DEBUG=0;
+	//the values searched for in the null distribution, in ascending order
+  queries=new double[queryNum];
+  for (i=0;i<groupNum;i++){
+    queries[2*i]=groups[i].loValue-0.000000001;
+    queries[2*i+1]=groups[i].loValue+0.000000001;
+  }
+  SortF(queries, queryNum);
+  histograms=new NULL_HISTOGRAM[threadNum];
+  for (i=0;i<threadNum;i++){
+    InitNullHistogram(histograms+i, queryNum+1);
+  }
+  InitNullHistogram(&total, queryNum+1);
+  position=new long long[queryNum];
+  passLoValues=new double[(long)groupNum*threadNum];
   
-  // set up control sequences
-  int n_control=0;
-  double* control_prob_array=NULL;
-  double ufvalue=0.5;
-  int rand_ctl_index=0;
-  int tmp_int;
-	if(UseControlSeq){
-    for(map<string,int>::iterator mit = ControlSeqMap.begin(); mit != ControlSeqMap.end(); mit++){
-      if(ControlSeqPercentile[mit->second]>=0){
-        n_control++;
-      }
-    }
-    control_prob_array=new double[n_control];
-    n_control=0;
-    for(map<string,int>::iterator mit = ControlSeqMap.begin(); mit != ControlSeqMap.end(); mit++){
-      if(ControlSeqPercentile[mit->second]>=0){
-        control_prob_array[n_control]=ControlSeqPercentile[mit->second];
-        n_control++;
-      }
-    }
+  // control sequences: a draw u takes the percentile at quantile u of the sorted control percentiles
+  int n_control=context->controlSeqNum;
+  const double* control_prob_array=context->controlSeqPercentile;
+	if(context->useControlSeq){
     cout<<"Total # control sgRNAs: "<<n_control<<endl;
   }
   
-	for (i=0;i<scanPass;i++){
-    for (j=0;j<groupNum;j++){
-			isallone=true;
-      int validsgs=0;
-			for (k=0;k<groups[j].itemNum;k++)
-			{
-        if(groups[j].items[k].isChosen==0) continue;
-        ufvalue=Uniform(0.0, 1.0);
-        if(UseControlSeq){
-          rand_ctl_index=(int)(n_control*ufvalue);
-          if(rand_ctl_index>=n_control) rand_ctl_index=n_control-1;
-          tmpPercentile[validsgs]=control_prob_array[rand_ctl_index];
-        }else{
-				  tmpPercentile[validsgs] = ufvalue;
-        }
-				tmpProb[validsgs]=groups[j].items[k].prob;
-				if(tmpProb[validsgs]!=1.0)
+	while (true){
+		ParallelFor(passNum-donePass, [&](int task, int threadId){
+			int pass = donePass+task;
+			double *passPercentile = tmpPercentile+(long)maxItemNum*threadId;
+			double *passProb = tmpProb+(long)maxItemNum*threadId;
+			RNG_STATE rng;
+			double *nullLoValue = passLoValues+(long)groupNum*threadId;
+			double ufvalue;
+			int j, k, rand_ctl_index, tmp_int;
+			bool isallone;
+			
+			InitRngState(&rng, context->rngMethod, RAND_SEED, 0, drawsPerPass*pass);
+			
+	    for (j=0;j<groupNum;j++){
+				isallone=true;
+	      int validsgs=0;
+				for (k=groups[j].itemStart;k<groups[j].itemStart+groups[j].itemNum;k++)
 				{
-					isallone=false;
+	        if(items->isChosen[k]==0) continue;
+	        ufvalue=RandomFromState(&rng);
+	        if(context->useControlSeq){
+	          rand_ctl_index=(int)(n_control*ufvalue);
+	          if(rand_ctl_index>=n_control) rand_ctl_index=n_control-1;
+	          passPercentile[validsgs]=control_prob_array[rand_ctl_index];
+	        }else{
+					  passPercentile[validsgs] = ufvalue;
+	        }
+					passProb[validsgs]=items->prob[k];
+					if(passProb[validsgs]!=1.0)
+					{
+						isallone=false;
+					}
+	        validsgs++;
+				} //end for k
+	      if(validsgs<=1)
+	        isallone=true;
+		
+				if(isallone){
+					ComputeLoValue(context, passPercentile, validsgs,nullLoValue[j], maxPercentile, tmp_int, scratch+threadId);
 				}
-        validsgs++;
-			} //end for k
-      if(validsgs<=1)
-        isallone=true;
-			
-			if(isallone){
-				ComputeLoValue(tmpPercentile, validsgs,randLoValue[randLoValueNum], maxPercentile, tmp_int);
+				else
+				{
+					ComputeLoValue_Prob(context, passPercentile, validsgs,nullLoValue[j], maxPercentile,passProb,tmp_int, scratch+threadId);
+				}
+			}// end for j
+		
+			SortF(nullLoValue, groupNum);
+			AddSortedNullValues(histograms+threadId, queries, nullLoValue, groupNum);
+		});
+		
+		for (i=0;i<threadNum;i++){
+			MergeNullHistogram(&total, histograms+i);
+			ClearNullHistogram(histograms+i);
+		}
+		donePass = passNum;
+		randLoValueNum = (double)passNum*groupNum;
+		//position of each query value in the sorted null, as bTreeSearchingF would find it
+		NullHistogramPositions(&total, queries, (long long)randLoValueNum, position);
+		
+		unresolvedNum = 0;
+		for (i=0;i<groupNum;i++){
+			int index1 = (int)(lower_bound(queries, queries+queryNum, groups[i].loValue-0.000000001)-queries);
+			int index2 = (int)(lower_bound(queries, queries+queryNum, groups[i].loValue+0.000000001)-queries);
+			groups[i].pvalue=((double)position[index1]+position[index2]+1)
+									/2/randLoValueNum;
+			if ((relError>0)&&(!PValueResolved((double)position[index2], (double)position[index2], randLoValueNum, minPValue, relError))){
+				unresolvedNum++;
 			}
-			else
-			{
-				ComputeLoValue_Prob(tmpPercentile, validsgs,randLoValue[randLoValueNum], maxPercentile,tmpProb,tmp_int);
+		}
+		
+		if ((relError<=0)||(unresolvedNum==0)||(passNum>=scanPass)){
+			break;
+		}
+		passNum = (2*passNum<scanPass)? 2*passNum : scanPass;
+	}
+	if (relError>0){
+		cout<<"Random passes: "<<passNum<<"; p-values not resolved: "<<unresolvedNum<<endl;
+	}
+	
+	//free(tmpPercentile);
+	//free(tmpProb);
+  delete []tmpPercentile;
+  delete []tmpProb;
+  delete []queries;
+  delete []passLoValues;
+  delete []position;
+  FreeNullHistogram(&total);
+  for (i=0;i<threadNum;i++){
+    FreeNullHistogram(histograms+i);
+  }
+  delete []histograms;
+  for (i=0;i<threadNum;i++){
+    FreeLoValueScratch(scratch+i);
+  }
+  delete []scratch;
+	
+	return 1;
+}
+
+//Set up the null strata of the groups: one stratum per distinct number of chosen items, none simulated yet.
+//Without per-sgRNA probabilities or control sgRNAs the null lo-value of a group only depends on its number of chosen
+//items, so every group of the same size shares one stratum. With --null-cache, the cache is opened here
+int InitNullStrata(NULL_STRATA *nullStrata, const RRA_CONTEXT *context, const ITEM_ARENA *items, const GROUP_STRUCT *groups,
+				   int groupNum, double maxPercentile)
+{
+	int i, k, s;
+	int *groupSize, *sizeStratum;
+	int threadNum = ThreadPoolSize();
+	
+	nullStrata->context = context;
+	if ((context->nullCacheDir!=NULL)&&(OpenNullCache(&nullStrata->cache, context->nullCacheDir)<=0)){
+		return -1;
+	}
+	
+	//number of chosen items in each group, and the histogram of these sizes
+	nullStrata->maxSize = 0;
+	groupSize = new int[groupNum];
+	for (i=0;i<groupNum;i++){
+		groupSize[i] = 0;
+		for (k=groups[i].itemStart;k<groups[i].itemStart+groups[i].itemNum;k++){
+			if (items->isChosen[k]!=0){
+				groupSize[i]++;
 			}
+		}
+		if (groupSize[i]>nullStrata->maxSize){
+			nullStrata->maxSize = groupSize[i];
+		}
+	}
+	
+	sizeStratum = new int[nullStrata->maxSize+1];
+	for (s=0;s<=nullStrata->maxSize;s++){
+		sizeStratum[s] = 0;
+	}
+	for (i=0;i<groupNum;i++){
+		sizeStratum[groupSize[i]]++;
+	}
+	
+	nullStrata->strata = new NULL_STRATUM[nullStrata->maxSize+1];
+	nullStrata->strataNum = 0;
+	for (s=0;s<=nullStrata->maxSize;s++){
+		NULL_STRATUM *stratum = nullStrata->strata+nullStrata->strataNum;
+		
+		if (sizeStratum[s]==0){
+			continue;
+		}
+		stratum->size = s;
+		stratum->groupNum = sizeStratum[s];
+		stratum->drawNum = 0;
+		stratum->draws = NULL;
+		stratum->loValue = NULL;
+		nullStrata->strataNum++;
+	}
+	
+	nullStrata->groupNum = groupNum;
+	nullStrata->passNum = 0;
+	nullStrata->maxPercentile = maxPercentile;
+	nullStrata->keys = new NULL_CACHE_KEY[nullStrata->strataNum];
+	nullStrata->sortedNum = new long[nullStrata->strataNum];
+	nullStrata->unitStratum = NULL;
+	nullStrata->unitStart = NULL;
+	nullStrata->unitNum = 0;
+	nullStrata->pending = false;
+	nullStrata->tmpPercentile = new double[(long)(nullStrata->maxSize+1)*threadNum];
+	nullStrata->scratch = new LOVALUE_SCRATCH[threadNum];
+	for (i=0;i<threadNum;i++){
+		InitLoValueScratch(nullStrata->scratch+i);
+	}
+	
+	delete []sizeStratum;
+	delete []groupSize;
+	
+	return 1;
+}
+
+//Start extending every stratum to the draws of passNum random passes, from the cache or by continuing its random sequence.
+//Each stratum stands for the passNum*(number of groups of its size) null values a full permutation would draw for it,
+//but simulates only passNum*NULL_DRAWS_PER_PASS of them when more groups share its size (and at most
+//MAX_NULL_DRAWS_PER_SIZE), each weighted accordingly. The simulation is then O(passNum*distinct sizes), and a simulated
+//value stands for at most 1/(passNum*NULL_DRAWS_PER_PASS) of the pooled null. Draws are made in chunks of
+//NULL_DRAW_CHUNK on the workers while the caller goes on; the random sequence of a stratum only depends on its size,
+//so results do not depend on the number of threads. FinishNullStrata waits for the draws
+void StartNullStrata(NULL_STRATA *nullStrata, int passNum)
+{
+	int s;
+	NULL_STRATUM *strata = nullStrata->strata;
+	long *sortedNum = nullStrata->sortedNum;
+	NULL_CACHE_KEY *keys = nullStrata->keys;
+	const RRA_CONTEXT *context = nullStrata->context;
+	int unitNum = 0;
+	
+	nullStrata->passNum = passNum;
+	for (s=0;s<nullStrata->strataNum;s++){
+		long drawNum = (long)passNum*((strata[s].groupNum<NULL_DRAWS_PER_PASS)? strata[s].groupNum : NULL_DRAWS_PER_PASS);
+		const double *found = NULL;
+		double *draws;
+		
+		if (drawNum>MAX_NULL_DRAWS_PER_SIZE){
+			drawNum = MAX_NULL_DRAWS_PER_SIZE;
+		}
+		strata[s].weight = (double)passNum*strata[s].groupNum/drawNum;
+		sortedNum[s] = drawNum;
+		if (drawNum==strata[s].drawNum){
+			continue;
+		}
+		
+		keys[s].size = strata[s].size;
+		keys[s].variant = context->loValueMethod+NULL_CACHE_RNG_VARIANT*context->rngMethod;
+		keys[s].maxPercentile = nullStrata->maxPercentile;
+		keys[s].seed = RAND_SEED;
+		keys[s].drawNum = drawNum;
+		if (context->nullCacheDir!=NULL){
+			found = FindNullCache(&nullStrata->cache, keys+s);
+		}
+		if ((found==NULL)&&(context->nullStore!=NULL)){
+			found = FindNullStore(context->nullStore, keys+s);
+		}
+		if (found!=NULL){
+			delete []strata[s].draws;
+			strata[s].draws = NULL;
+			strata[s].loValue = found;
+			strata[s].drawNum = drawNum;
+			continue;
+		}
+		
+		//the values drawn so far are kept, in ascending order, at the start of the extended array
+		draws = new double[drawNum];
+		if (strata[s].drawNum>0){
+			memcpy(draws, strata[s].loValue, strata[s].drawNum*sizeof(double));
+		}
+		delete []strata[s].draws;
+		sortedNum[s] = strata[s].drawNum;
+		strata[s].draws = draws;
+		strata[s].loValue = draws;
+		strata[s].drawNum = drawNum;
+		unitNum += (int)((drawNum-sortedNum[s]+NULL_DRAW_CHUNK-1)/NULL_DRAW_CHUNK);
+	}
+	
+	//work units: consecutive chunks of the new draws of each simulated stratum
+	nullStrata->unitStratum = new int[unitNum];
+	nullStrata->unitStart = new long[unitNum];
+	nullStrata->unitNum = 0;
+	for (s=0;s<nullStrata->strataNum;s++){
+		long start;
+		for (start=sortedNum[s];start<strata[s].drawNum;start+=NULL_DRAW_CHUNK){
+			nullStrata->unitStratum[nullStrata->unitNum] = s;
+			nullStrata->unitStart[nullStrata->unitNum] = start;
+			nullStrata->unitNum++;
+		}
+	}
+	nullStrata->pending = true;
+	
+	StartParallelFor(nullStrata->unitNum, [nullStrata](int unit, int threadId){
+		NULL_STRATUM *stratum = nullStrata->strata+nullStrata->unitStratum[unit];
+		double *drawPercentile = nullStrata->tmpPercentile+(long)(nullStrata->maxSize+1)*threadId;
+		long start = nullStrata->unitStart[unit];
+		long end = (start+NULL_DRAW_CHUNK<stratum->drawNum)? start+NULL_DRAW_CHUNK : stratum->drawNum;
+		RNG_STATE rng;
+		long d;
+		int tmp_int;
+
+		InitRngState(&rng, nullStrata->context->rngMethod, RAND_SEED, stratum->size, start*stratum->size);
+		for (d=start;d<end;d++){
+			RandomFill(&rng, drawPercentile, stratum->size);
+			ComputeLoValue(nullStrata->context, drawPercentile, stratum->size, stratum->draws[d], nullStrata->maxPercentile, tmp_int,
+						   nullStrata->scratch+threadId);
+		}
+	});
+}
+
+//Wait for the draws started by StartNullStrata and merge them into the sorted null lo-values of each stratum
+void FinishNullStrata(NULL_STRATA *nullStrata)
+{
+	int s;
+	NULL_STRATUM *strata = nullStrata->strata;
+	long *sortedNum = nullStrata->sortedNum;
+	
+	if (!nullStrata->pending){
+		return;
+	}
+	FinishParallelFor();
+	
+	for (s=0;s<nullStrata->strataNum;s++){
+		if (sortedNum[s]<strata[s].drawNum){
+			SortF(strata[s].draws+sortedNum[s], (int)(strata[s].drawNum-sortedNum[s]));
+			inplace_merge(strata[s].draws, strata[s].draws+sortedNum[s], strata[s].draws+strata[s].drawNum);
+		}
+	}
+	delete []nullStrata->unitStratum;
+	delete []nullStrata->unitStart;
+	nullStrata->unitStratum = NULL;
+	nullStrata->unitStart = NULL;
+	nullStrata->unitNum = 0;
+	nullStrata->pending = false;
+}
+
+//Release the null strata; the newly simulated strata are first appended to the cache with --null-cache, and to the
+//null store of the context if it has one
+void FreeNullStrata(NULL_STRATA *nullStrata)
+{
+	int i, s;
+	int cachedNum = 0, newNum = 0;
+	int threadNum = ThreadPoolSize();
+	NULL_STRATUM *strata = nullStrata->strata;
+	NULL_CACHE_KEY *keys = nullStrata->keys;
+	const double **newValues;
+	
+	FinishNullStrata(nullStrata);
+	
+	newValues = new const double*[nullStrata->strataNum];
+	for (s=0;s<nullStrata->strataNum;s++){
+		if (strata[s].draws==NULL){
+			cachedNum++;
+		}else{
+			keys[newNum] = keys[s];
+			newValues[newNum] = strata[s].draws;
+			newNum++;
+		}
+	}
+	cout<<"Null lo-values of "<<nullStrata->strataNum<<" distinct group sizes: "<<cachedNum<<" from cache, "<<newNum<<" simulated."<<endl;
+	if ((nullStrata->context->nullCacheDir!=NULL)&&(newNum>0)){
+		AppendNullCache(&nullStrata->cache, keys, newValues, newNum);
+	}
+	if ((nullStrata->context->nullStore!=NULL)&&(newNum>0)){
+		AddNullStore(nullStrata->context->nullStore, keys, newValues, newNum);
+	}
+	
+	for (s=0;s<nullStrata->strataNum;s++){
+		delete []strata[s].draws;
+	}
+	if (nullStrata->context->nullCacheDir!=NULL){
+		CloseNullCache(&nullStrata->cache);
+	}
+	delete []newValues;
+	delete []keys;
+	delete []nullStrata->sortedNum;
+	for (i=0;i<threadNum;i++){
+		FreeLoValueScratch(nullStrata->scratch+i);
+	}
+	delete []nullStrata->scratch;
+	delete []nullStrata->tmpPercentile;
+	delete []strata;
+}
+
+//Start the null simulation of the first batch of random passes before the observed lo-values are known, when the null
+//percentiles are uniform and p-values come from random passes. Returns 1 if started, 0 if the null needs the observed
+//values (or none is simulated), -1 on error. The started strata are handed to ComputeFDR and freed by the caller
+int StartUniformNull(const RRA_CONTEXT *context, const ITEM_ARENA *items, const GROUP_STRUCT *groups, int groupNum,
+					 double maxPercentile, int numOfRandPass, NULL_STRATA *nullStrata)
+{
+	double minPValue = context->minPValue, relError = context->pvalueRelError;
+	int scanPass;
+	
+	if ((context->pvalueMethod==PVALUE_EXACT)||(context->rngMethod==RNG_LEHMER)||(!UniformNullPercentiles(context, items))){
+		return 0;
+	}
+	scanPass = RandomPassNum(groupNum, numOfRandPass, &minPValue, &relError);
+	if (InitNullStrata(nullStrata, context, items, groups, groupNum, maxPercentile)<=0){
+		return -1;
+	}
+	StartNullStrata(nullStrata, FirstPassNum(scanPass, relError));
+	
+	return 1;
+}
+
+//p-values from null lo-values simulated once per group size and weighted by the group-size histogram. The p-value has
+//the definition of the permutation path, with each simulated value counted by its weight: the positions of lo-value+-1e-9
+//found by bTreeSearchingF in the pooled null (see NullPosition). Strata already started by the caller for the first batch
+//are used as they are.
+//With relError>0, scanPass is an upper bound: passes are added in batches, each stratum continuing its random sequence,
+//until every p-value is resolved (see PValueResolved) or every stratum is at MAX_NULL_DRAWS_PER_SIZE
+int ComputeStratifiedPValues(NULL_STRATA *nullStrata, GROUP_STRUCT *groups, int groupNum, int scanPass,
+							 double minPValue, double relError)
+{
+	int s;
+	NULL_STRATUM *strata = nullStrata->strata;
+	int strataNum = nullStrata->strataNum;
+	int passNum = FirstPassNum(scanPass, relError);
+	double randNum;
+	std::atomic<int> unresolvedNum(0);
+	bool capped;
+	
+	while (true){
+		randNum = (double)passNum*groupNum;
+		
+		if (nullStrata->passNum!=passNum){
+			StartNullStrata(nullStrata, passNum);
+		}
+		FinishNullStrata(nullStrata);
+		
+		//positions of each observed lo-value+-1e-9 in the pooled null
+		unresolvedNum = 0;
+		ParallelFor(groupNum, [&](int g, int threadId){
+			double query[2] = {groups[g].loValue-0.000000001, groups[g].loValue+0.000000001};
+			double position[2];
+			double upTo = 0.0, upToVar = 0.0;
+			long n;
+			int q, t;
 			
-			randLoValueNum++;
-		}// end for j
-	}//end for i
+			for (q=0;q<2;q++){
+				double below = 0.0, pred = -HUGE_VAL, succ = HUGE_VAL;
+				
+				for (t=0;t<strataNum;t++){
+					const double *first = strata[t].loValue;
+					const double *last = first+strata[t].drawNum;
+					n = lower_bound(first, last, query[q])-first;
+					below += strata[t].weight*n;
+					if ((n>0)&&(first[n-1]>pred)){
+						pred = first[n-1];
+					}
+					if ((n<strata[t].drawNum)&&(first[n]<succ)){
+						succ = first[n];
+					}
+				}
+				position[q] = NullPosition(query[q], below, pred, succ, randNum);
+			}
+			groups[g].pvalue = (position[0]+position[1]+1)/2/randNum;
+			for (t=0;t<strataNum;t++){
+				const double *first = strata[t].loValue;
+				n = upper_bound(first, first+strata[t].drawNum, query[1])-first;
+				upTo += strata[t].weight*n;
+				upToVar += strata[t].weight*strata[t].weight*n;
+			}
+			if ((relError>0)&&(!PValueResolved(upTo, upToVar, randNum, minPValue, relError))){
+				unresolvedNum++;
+			}
+		});
+		
+		capped = true;
+		for (s=0;s<strataNum;s++){
+			if (strata[s].drawNum<MAX_NULL_DRAWS_PER_SIZE){
+				capped = false;
+			}
+		}
+		if ((relError<=0)||(unresolvedNum.load()==0)||(passNum>=scanPass)||capped){
+			break;
+		}
+		passNum = (2*passNum<scanPass)? 2*passNum : scanPass;
+	}
+	if (relError>0){
+		cout<<"Random passes: "<<passNum<<"; p-values not resolved: "<<unresolvedNum.load()<<endl;
+	}
+	
+	return 1;
+}
+
+//Whether a p-value from random passes is resolved: the relative standard error of count, the (weighted) number of null
+//values at or below the lo-value with variance countVar, is within relError, or the p-value is known to lie below minPValue
+bool PValueResolved(double count, double countVar, double nullNum, double minPValue, double relError)
+{
+	if ((count+1)/nullNum<=minPValue){
+		return true;
+	}
+	return (count>0)&&(countVar<=relError*relError*count*count);
+}
+
+//P(lo-value<=t) for num uniform percentiles, the exact null CDF of the lo-value (the rho score of Kolde et al.).
+//The lo-value is at most t exactly when some counted order statistic X_(i+1) lies below bound[i], the t-quantile of its beta
+//distribution, capped at maxPercentile for the ranks after the first. Once a cap is reached the later ranks add nothing
+double LoValueNullCdf(double t, int num, double maxPercentile, double *bound, double *work)
+{
+	int i;
+	
+	if ((num==0)||(t>=1.0)){
+		return (t>=1.0)? 1.0 : 0.0;
+	}
+	
+	bound[0] = OrderStatisticQuantile(0, num, t, 0.0);
+	
+	//no later rank within the cutoff can reach t before the first one does
+	if (bound[0]>=maxPercentile){
+		return t;
+	}
+	
+	for (i=1;i<num;i++){
+		if (OrderStatisticCdfAt(i, num, maxPercentile)<=t){
+			bound[i] = maxPercentile;
+			i++;
+			break;
+		}
+		bound[i] = OrderStatisticQuantile(i, num, t, bound[i-1]);
+	}
+	
+	return OrderStatisticCrossing(bound, num, i, work);
+}
+
+//p-values from the exact null distribution of the lo-value of each group, given its number of chosen items.
+//Without per-sgRNA probabilities or control sgRNAs the null percentiles are uniform, so no random passes are needed
+//and the p-values are not limited by the number of passes
+int ComputeExactPValues(const ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, double maxPercentile)
+{
+	int i, k;
+	int *groupSize;
+	int maxSize = 1;
+	int threadNum = ThreadPoolSize();
+	double *bound, *work;
+	
+	groupSize = new int[groupNum];
+	for (i=0;i<groupNum;i++){
+		groupSize[i] = 0;
+		for (k=groups[i].itemStart;k<groups[i].itemStart+groups[i].itemNum;k++){
+			if (items->isChosen[k]!=0){
+				groupSize[i]++;
+			}
+		}
+		if (groupSize[i]>maxSize){
+			maxSize = groupSize[i];
+		}
+	}
+	
+	bound = new double[(long)maxSize*threadNum];
+	work = new double[2L*maxSize*threadNum];
+	
+	ParallelFor(groupNum, [&](int g, int threadId){
+		double p = LoValueNullCdf(groups[g].loValue, groupSize[g], maxPercentile,
+								  bound+(long)maxSize*threadId, work+2L*maxSize*threadId);
+		
+		groups[g].pvalue = (p<1.0)? p : 1.0;
+	});
+	
+	delete []bound;
+	delete []work;
+	delete []groupSize;
+	
+	return 1;
+}
+
+//Whether the null lo-value of every group only depends on its number of chosen items
+bool UniformNullPercentiles(const RRA_CONTEXT *context, const ITEM_ARENA *items)
+{
+	int i;
+	
+	if (context->useControlSeq){
+		return false;
+	}
+	//per-sgRNA probabilities tie the null lo-value of a group to its own items
+	for (i=0;i<items->itemNum;i++){
+		if ((items->isChosen[i]!=0)&&(items->prob[i]!=1.0)){
+			return false;
+		}
+	}
+	return true;
+}
+
+//Number of random passes. With adaptive passes (--min-pvalue or --pvalue-error) it is the number of passes that resolves
+//minPValue to relError, an upper bound of the passes actually run, and the defaults of minPValue and relError are filled in
+int RandomPassNum(int groupNum, int numOfRandPass, double *minPValue, double *relError)
+{
+	int scanPass = numOfRandPass/groupNum+1;
+	
+	if ((*minPValue>0)||(*relError>0)){
+		if (*relError<=0){
+			*relError = ADAPTIVE_REL_ERROR;
+		}
+		if (*minPValue<=0){
+			*minPValue = 1.0/numOfRandPass;
+		}
+		scanPass = (int)ceil(1.0/((*relError)*(*relError)*(*minPValue)*groupNum));
+		if (scanPass>MAX_ADAPTIVE_PASS_NUM){
+			scanPass = MAX_ADAPTIVE_PASS_NUM;
+		}
+		if (scanPass<ADAPTIVE_FIRST_PASS_NUM){
+			scanPass = ADAPTIVE_FIRST_PASS_NUM;
+		}
+	}
+	return scanPass;
+}
+
+//Number of random passes of the first batch: all of them, or ADAPTIVE_FIRST_PASS_NUM with adaptive passes
+int FirstPassNum(int scanPass, double relError)
+{
+	if ((relError>0)&&(ADAPTIVE_FIRST_PASS_NUM<scanPass)){
+		return ADAPTIVE_FIRST_PASS_NUM;
+	}
+	return scanPass;
+}
+
+//Compute False Discovery Rate based on uniform distribution. The null is simulated per group size, except with
+//--rng lehmer, which keeps the per-group random passes of earlier releases
+int ComputeFDR(const RRA_CONTEXT *context, const ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, double maxPercentile,
+			   int numOfRandPass, int *order, NULL_STRATA *nullStrata)
+{
+	int i;
+	bool stratified = UniformNullPercentiles(context, items);
+	double minPValue = context->minPValue, relError = context->pvalueRelError;
+	int scanPass = RandomPassNum(groupNum, numOfRandPass, &minPValue, &relError);
+	NULL_STRATA localStrata;
+	
+	if ((context->pvalueMethod==PVALUE_EXACT)&&(!stratified)){
+		cout<<"Exact p-values need uniform null percentiles; using permutation with control sgRNAs or sgRNA probabilities."<<endl;
+	}
 	
-	QuicksortF(randLoValue, 0, randLoValueNum-1);
-						  
-	QuickSortGroupByLoValue(groups, 0, groupNum-1);
+	if ((context->pvalueMethod==PVALUE_EXACT)&&stratified){
+		ComputeExactPValues(items, groups, groupNum, maxPercentile);
+	}else if (stratified&&(context->rngMethod!=RNG_LEHMER)){
+		if (nullStrata!=NULL){
+			ComputeStratifiedPValues(nullStrata, groups, groupNum, scanPass, minPValue, relError);
+		}else{
+			if (InitNullStrata(&localStrata, context, items, groups, groupNum, maxPercentile)<=0){
+				return -1;
+			}
+			ComputeStratifiedPValues(&localStrata, groups, groupNum, scanPass, minPValue, relError);
+			FreeNullStrata(&localStrata);
+		}
+	}else{
+		ComputePermutationPValues(context, items, groups, groupNum, maxPercentile, scanPass, minPValue, relError);
+	}
+	
+	SortGroupsByLoValue(groups, groupNum, order);
 	
   //FDR calcuation
   int goodGroupNum=0;
@@ -592,25 +2086,21 @@ int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int num
   int* indexval=new int[goodGroupNum];
   int goodindex=0;
 	for (i=0;i<groupNum;i++){
-		//groups[i].fdr = (double)(bTreeSearchingF(groups[i].loValue-0.000000001, randLoValue, 0, randLoValueNum-1)
-		//						 +bTreeSearchingF(groups[i].loValue+0.000000001, randLoValue, 0, randLoValueNum-1)+1)
-		//						/2/randLoValueNum/((double)i+0.5)*groupNum;
-    if(groups[i].isbad==0){
-      groups[i].pvalue=(double)(bTreeSearchingF(groups[i].loValue-0.000000001, randLoValue, 0, randLoValueNum-1)
-								 +bTreeSearchingF(groups[i].loValue+0.000000001, randLoValue, 0, randLoValueNum-1)+1)
-								/2/randLoValueNum;
-		  groups[i].fdr = groups[i].pvalue/((double)i+1.0)*goodGroupNum;
-      indexval[goodindex]=i;
+    GROUP_STRUCT *group = groups+order[i];
+    
+    if(group->isbad==0){
+		  group->fdr = group->pvalue/((double)i+1.0)*goodGroupNum;
+      indexval[goodindex]=order[i];
       goodindex++;
     }else{
-      groups[i].pvalue=1.0;
-      groups[i].fdr=1.0;
+      group->pvalue=1.0;
+      group->fdr=1.0;
     }
 	}
 	
-	if (groups[groupNum-1].fdr>1.0)
+	if (groups[order[groupNum-1]].fdr>1.0)
 	{
-		groups[groupNum-1].fdr = 1.0;
+		groups[order[groupNum-1]].fdr = 1.0;
 	}
 	
 	for (i=goodGroupNum-2;i>=0;i--){
@@ -621,55 +2111,30 @@ int ComputeFDR(GROUP_STRUCT *groups, int groupNum, double maxPercentile, int num
 		}
 	}
 	
-	//free(tmpPercentile);
-	//free(tmpProb);
-	//free(randLoValue);
-  delete []tmpPercentile;
-  delete []tmpProb;
-  delete []randLoValue;
-  
-  if(UseControlSeq){
-    delete[] control_prob_array;
-  }
   delete []indexval;
 	
 	return 1;
 }
 
-//QuickSort groups by loValue
-void QuickSortGroupByLoValue(GROUP_STRUCT *groups, int lo, int hi)
+//Order groups by loValue; groups with equal lo-values keep their input order. Only (loValue, group index) keys are
+//sorted; the group table is left in input order
+void SortGroupsByLoValue(const GROUP_STRUCT *groups, int groupNum, int *order)
 {
-	int i=lo, j=hi;
-	GROUP_STRUCT tmpGroup;
-	double x=groups[(lo+hi)/2].loValue;
+	int i;
+	INDEXED_FLOAT *keys = new INDEXED_FLOAT[groupNum];
 	
-	if (hi<lo)
+	for (i=0;i<groupNum;i++)
 	{
-		return;
+		keys[i].value = groups[i].loValue;
+		keys[i].index = i;
 	}
 	
-    //  partition
-    while (i<=j)
-    {    
-		while ((groups[i].loValue<x)&&(i<=j))
-		{
-			i++;
-		}
-		while ((groups[j].loValue>x)&&(i<=j))
-		{
-			j--;
-		}
-        if (i<=j)
-        {
-			memcpy(&tmpGroup,groups+i,sizeof(GROUP_STRUCT));
-			memcpy(groups+i,groups+j,sizeof(GROUP_STRUCT));
-			memcpy(groups+j,&tmpGroup,sizeof(GROUP_STRUCT));
-            i++; j--;
-        }
-    } 
+	SortIndexedArray(keys, groupNum);
 	
-    //  recursion
-    if (lo<j) QuickSortGroupByLoValue(groups, lo, j);
-    if (i<hi) QuickSortGroupByLoValue(groups, i, hi);
+	for (i=0;i<groupNum;i++)
+	{
+		order[i] = keys[i].index;
+	}
 	
+	delete []keys;
 }
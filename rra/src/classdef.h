@@ -7,39 +7,55 @@
 #include <stdlib.h>
 #include <memory.h>
 
+#include "namepool.h"
+#include "nullcache.h"
+
 #define NDEBUG
 #include <assert.h>
 
-#define MAX_NAME_LEN 10000           //maximum length of item name, group name or list name
 #define CDF_MAX_ERROR 1E-10        //maximum error in Cumulative Distribution Function estimation in beta statistics
-#define MAX_GROUP_NUM 100000       //maximum number of groups
-#define MAX_LIST_NUM 1000          //maximum number of list 
 #define RAND_PASS_NUM 100          //number of passes in random simulation for computing FDR
+#define RAND_SEED 123456           //seed of the random simulation
+#define MAX_NULL_DRAWS_PER_SIZE 1000000 //maximum number of null lo-values simulated for one group size
+#define NULL_DRAWS_PER_PASS 1000   //null lo-values simulated per random pass for one group size; p-values are resolved to 1/(passes*NULL_DRAWS_PER_PASS) or finer
+#define NULL_DRAW_CHUNK 4096       //number of null lo-values simulated by one task
+#define ADAPTIVE_FIRST_PASS_NUM 10 //number of random passes in the first batch of adaptive passes, doubled in every batch
+#define MAX_ADAPTIVE_PASS_NUM 100000 //maximum number of adaptive random passes
+#define ADAPTIVE_REL_ERROR 0.1     //default relative standard error of adaptive p-values
+#define PROB_LOVALUE_TOL 1E-4      //CDF breakpoints of probability-weighted lo-values within this relative distance are merged; the relative error of such a lo-value is at most PROB_LOVALUE_TOL/2
 
 #define MAX_WORD_NUM 1000        //maximum number of word
 
+#define LOVALUE_ORDERSTAT 0        //lo-values from the binomial order-statistic kernel (default)
+#define LOVALUE_BETAIN 1           //lo-values from the incomplete beta function, for validation
+#define NULL_CACHE_RNG_VARIANT 256 //null cache variant = lo-value method + NULL_CACHE_RNG_VARIANT * random generator
+
+#define PVALUE_PERMUTATION 0       //p-values from random passes (default)
+#define PVALUE_EXACT 1             //p-values from the exact null distribution of the lo-value
+
 //WL: define boolean variables
 //typedef int bool;
 //#define true 1
 //#define false 0
 
 
-typedef struct // item definition; i.e., sgRNA
+typedef struct // item definition; i.e., sgRNAs. All items are stored as parallel arrays, the items of a group contiguously
 {
-	char name[MAX_NAME_LEN];       //name of the item
-	int listIndex;                 //index of list storing the item
-	double value;                  //value of measurement
-	double percentile;             //percentile in the list
-	double prob;			//The probability of each sgRNA; added by Wei
-  int isChosen;  //whether this sgRNA should be considered in calculation
-} ITEM_STRUCT;
+	unsigned int *nameId;          //id of the item name in the item name pool
+	int *listIndex;                //index of list storing the item
+	double *value;                 //value of measurement
+	double *percentile;            //percentile in the list
+	double *prob;                  //The probability of each sgRNA; added by Wei
+	char *isChosen;                //whether this sgRNA should be considered in calculation
+	int *origin;                   //index of the first copy of the same input row, for items listed under several groups
+	int itemNum;                   //number of items
+} ITEM_ARENA;
 
 typedef struct // group definition; i.e., gene
 {
-	char name[MAX_NAME_LEN];       //name of the group
-	ITEM_STRUCT *items;            //items in the group
+	unsigned int nameId;           //id of the group name in the group name pool; equal to the group index
+	int itemStart;                 //index of the first item of the group in the item arena
 	int itemNum;                   //number of items in the group
-  int maxItemNum;                // max number of items
 	double loValue;                //lo-value in RRA
   double pvalue;                //p value for permutation
 	double fdr;                    //false discovery rate
@@ -49,11 +65,94 @@ typedef struct // group definition; i.e., gene
 
 typedef struct //list definition; i.e., gene groups
 {
-	char name[MAX_NAME_LEN];       //name of the list
-	double *values;                //values of items in the list, used for sorting
+	unsigned int nameId;           //id of the list name in the list name pool; equal to the list index
+	int *items;                    //arena indexes of the items in the list, sorted by value in ProcessGroups
 	int itemNum;                   //number of items in the list
   int maxItemNum;               //max item number
 } LIST_STRUCT;
 
 
+typedef struct // options and state of one rank aggregation, passed through the analysis so that several can run in one process
+{
+	int loValueMethod;             //LOVALUE_*
+	int rngMethod;                 //random generator of the null simulation, RNG_* of rngs.h
+	int pvalueMethod;              //PVALUE_*
+	double minPValue;              //adaptive random passes: p-values are resolved down to minPValue, 0 if not used
+	double pvalueRelError;         //relative error of the adaptive p-values, 0 if not used
+	const char *nullCacheDir;      //directory of the null lo-value cache, NULL if not used
+	bool printDebug;               //print the sgRNA probabilities and lo-value of each probability-weighted group
+	bool useControlSeq;            //whether the null percentiles are drawn from control sequences
+	NAME_POOL controlSeqNames;     //names of the control sequences, the name id is the control index; set up when loaded
+	int *controlSeqItem;           //item index of each control sequence, resolved once after reading the input; -1 if not found
+	double *controlSeqPercentile;  //percentiles of the control sequences found, in ascending order (by control name with RNG_LEHMER)
+	int controlSeqNum;             //number of control sequences found
+	NULL_STORE *nullStore;         //null lo-values shared with the other analyses of the process, NULL if not used
+} RRA_CONTEXT;
+
+typedef struct // value columns of a matrix input: the rankings of several contrasts over the items of one item arena
+{
+	int contrastNum;               //number of contrasts
+	NAME_POOL contrastNames;       //contrast names from the header; the name id is the contrast index
+	double *values;                //values[(long)c*itemNum+k]: value of item k of the arena in contrast c
+} CONTRAST_MATRIX;
+
+typedef struct // one analysis of the RRA command: a job of a --batch manifest, or the command line itself
+{
+	const char *inputFileName;     //ranked list
+	const char *outputFileName;    //group summary
+	const char *controlFileName;   //control sequences, loaded when the job runs; NULL if not used
+	double maxPercentile;          //percentile cutoff (-p); of the negative selection with dualTail
+	bool dualTail;                 //rank the values in both directions and save the merged summary (--dual-tail)
+	double posMaxPercentile;       //percentile cutoff of the positive selection, negative to use maxPercentile (--p-pos)
+	bool sortByPos;                //sort the merged summary by the positive selection (--sort-criteria pos)
+	bool matrix;                   //the input has one value column per contrast; save the summary of all contrasts (--matrix)
+	RRA_CONTEXT context;           //options of the analysis
+} RRA_JOB;
+
+typedef struct // scratch memory of the lo-value computation; each thread uses its own
+{
+	double *lovarray;              //sorted percentiles followed by their order-statistic CDFs
+	int nLovarray;                 //number of percentiles lovarray can hold
+	double *probLovarray;          //work space of the probability-weighted lo-value
+	long nProbLovarray;            //length of probLovarray
+} LOVALUE_SCRATCH;
+
+typedef struct // null lo-values of the groups with a given number of chosen items
+{
+	int size;                      //number of chosen items
+	int groupNum;                  //number of groups of this size
+	long drawNum;                  //number of simulated null lo-values
+	double weight;                 //number of pooled null values each simulated value stands for
+	double *draws;                 //lo-values simulated in this run, NULL if they come from the null cache
+	const double *loValue;         //null lo-values, in ascending order
+} NULL_STRATUM;
+
+typedef struct // null lo-values of all group sizes, extended in batches of random passes
+{
+	const RRA_CONTEXT *context;    //analysis the strata are simulated for
+	NULL_STRATUM *strata;          //one stratum per distinct number of chosen items, by increasing size
+	int strataNum;                 //number of strata
+	int maxSize;                   //largest number of chosen items of a group
+	int groupNum;                  //number of groups
+	int passNum;                   //number of random passes the strata are extended to
+	double maxPercentile;          //percentile cutoff of the lo-values
+	NULL_CACHE cache;              //null lo-value cache, open if the context has a cache directory
+	NULL_CACHE_KEY *keys;          //cache key of each stratum
+	long *sortedNum;               //number of leading null lo-values of each stratum in ascending order
+	int *unitStratum;              //stratum of each work unit of the draws in progress
+	long *unitStart;               //first draw of each work unit
+	int unitNum;                   //number of work units
+	bool pending;                  //whether draws were started and not yet finished
+	double *tmpPercentile;         //percentiles of one draw, for each thread
+	LOVALUE_SCRATCH *scratch;      //lo-value work space of each thread
+} NULL_STRATA;
+
+typedef struct // null values counted between consecutive query values (sorted), for p-values without storing the null
+{
+	long long *count;              //count[b]: number of null values with exactly b query values at or below them
+	double *minValue;              //smallest null value counted in each bucket
+	double *maxValue;              //largest null value counted in each bucket
+	int bucketNum;                 //number of query values + 1
+} NULL_HISTOGRAM;
+
 #endif
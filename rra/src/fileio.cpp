@@ -1,278 +1,548 @@
 //C++ functions
-#include <string>
-#include <vector>
-#include <map>
+#include <charconv>
 #include <iostream>
-#include <fstream>
 using namespace std;
 
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "fileio.h"
 
 
-//split strings
-int stringSplit(string str, string delim, vector<string> & v){
-  int start=0;
-  int pos=str.find_first_of(delim,start);
-  v.clear();
-  while(pos!=str.npos){
-    if(pos!=start)
-      v.push_back(str.substr(start,pos-start));
-     start=pos+1;
-     pos=str.find_first_of(delim,start);
-  }
-  if(start<str.length())
-    v.push_back(str.substr(start,str.length()-start));
-  return v.size();
+//memory-mapped view of an input file
+typedef struct
+{
+  const char *data;              //first byte of the file
+  size_t size;                   //number of bytes in the file
+} MAPPED_FILE;
+
+//token in a mapped line; not null-terminated
+typedef struct
+{
+  const char *str;
+  int len;
+} TOKEN;
+
+//map a file into memory. Return 0 if success, -1 if failure
+static int MapFile(const char *fileName, MAPPED_FILE *mf)
+{
+  struct stat st;
+  int fd;
+
+  mf->data = NULL;
+  mf->size = 0;
+  fd = open(fileName, O_RDONLY);
+  if (fd<0){
+    return -1;
+  }
+  if (fstat(fd, &st)!=0){
+    close(fd);
+    return -1;
+  }
+  mf->size = (size_t)st.st_size;
+  if (mf->size>0){
+    void *p = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p==MAP_FAILED){
+      close(fd);
+      return -1;
+    }
+    madvise(p, mf->size, MADV_SEQUENTIAL);
+    mf->data = (const char *)p;
+  }
+  close(fd);
+  return 0;
 }
 
-int getGroupListNum(char* fileName, GROUP_STRUCT* groups, LIST_STRUCT* lists, int maxGroupNum, int maxListNum, int &groupNum, int& listNum, map<string,int>& groupNames, map<string,int>& listNames){
-  // determine the group number and list number
-  // if success, return 0; else, return -1;
-	
-	int i,k;
-	//char **words, *tmpS, *tmpS2;
-	int wordNum;
-	int tmpGroupNum, tmpListNum;
-
-	ifstream fh;
-  fh.open(fileName);
-  if(!fh.is_open()){
-    cerr<<"Error opening "<<fileName<<endl;
+static void UnmapFile(MAPPED_FILE *mf)
+{
+  if (mf->data!=NULL){
+    munmap((void *)mf->data, mf->size);
   }
-  string oneline;
-  getline(fh,oneline);
-  
-  vector<string> vwords;
-  vector<string> vsubwords;
-  wordNum=stringSplit(oneline," \t\r\n\v",vwords);
-	//Read the header row to get the sample number
-	//fgets(tmpS, MAX_WORD_NUM*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	//wordNum = StringToWords(words, tmpS,MAX_WORD_NUM, MAX_NAME_LEN+1,  " \t\r\n\v\f");
-	
-	
-	if (wordNum < 4 || wordNum > 6){
-		cerr<<"Error: incorrect input file format: <item id> <group id> <list id> <value> [<prob>] [iscounted]\n";
-    fh.close();
-		return -1;
-	}
-	
-	//read records of items
-	
-	tmpGroupNum = 0;
-	tmpListNum = 0;
-	
-	//fgets(tmpS, MAX_WORD_NUM*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	//wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_NUM, " \t\r\n\v\f");
-  getline(fh,oneline);
-  wordNum=stringSplit(oneline," \t\r\f\v",vwords);
+  mf->data = NULL;
+  mf->size = 0;
+}
 
-	
-	//WL
- int subWordNum;
- subWordNum=0;
-
-	while ((wordNum>=4 )&&(!fh.eof()))
-	{
-    
-    // separate the group name by ","
-    subWordNum=stringSplit(vwords[1],",",vsubwords);
-    assert(subWordNum>0);
-    
-		for(k=0;k<subWordNum;k++){
-	  		//for (i=0;i<tmpGroupNum;i++) if (!strcmp(vsubwords[k].c_str(), groups[i].name))	break;
-        string subwstr=vsubwords[k];
-	  	
-	  		if (groupNames.count(subwstr)==0){
-	  			strcpy(groups[tmpGroupNum].name, vsubwords[k].c_str());
-	  			groups[tmpGroupNum].itemNum = 1;
-          groupNames[subwstr]=tmpGroupNum;
-	  			tmpGroupNum ++;
-	  			if (tmpGroupNum >= maxGroupNum){
-	  				printf("Error: too many groups. maxGroupNum = %d\n", maxGroupNum);
-	  				return -1;
-	  			}
-	  		}
-	  		else{
-          i=groupNames[subwstr];
-	  			groups[i].itemNum++;
-	  		}
-		}
-
-		//for (i=0;i<tmpListNum;i++)	if (!strcmp(vwords[2].c_str(), lists[i].name))	break;
-		string thisliststr=vwords[2];
-		if (listNames.count(thisliststr)==0){
-			strcpy(lists[tmpListNum].name, vwords[2].c_str());
-			lists[tmpListNum].itemNum = 1;
-      listNames[thisliststr]=tmpListNum;
-			tmpListNum ++;
-			if (tmpListNum >= maxListNum){
-				printf("Error: too many lists. maxListNum = %d\n", maxListNum);
-				return -1;
-			}
-		}
-		else{
-      i=listNames[thisliststr];
-			lists[i].itemNum++;
-		}
-		
-		
-    getline(fh,oneline);
-    wordNum=stringSplit(oneline," \t\r\f\v",vwords);
-		//fgets(tmpS, MAX_WORD_NUM*(MAX_NAME_LEN+1)*sizeof(char), fh);
-		//wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_NUM, " \t\r\n\v\f");
-	}
-	
-	fh.close();
-  
-  groupNum=tmpGroupNum;
-  listNum=tmpListNum;
-	
-  return 0;
+static inline bool IsFieldDelim(char c)
+{
+  return c==' ' || c=='\t' || c=='\r' || c=='\v' || c=='\f';
 }
 
-//Read input file. File Format: <item id> <group id> <list id> <value>. Return 1 if success, -1 if failure
-int ReadFile(char *fileName, GROUP_STRUCT *groups, int maxGroupNum, int *groupNum, 
-      LIST_STRUCT *lists, int maxListNum, int *listNum)
+//split the line starting at *pos into at most maxToken tokens, and advance *pos to the next line.
+//Return the number of tokens in the line
+static int NextLineTokens(const char **pos, const char *end, TOKEN *tokens, int maxToken)
 {
-	//FILE *fh;
-	int i,j,k;
-	//char **words, *tmpS, *tmpS2;
-	int wordNum=0;
-	int totalItemNum=0;
-	int tmpGroupNum=0, tmpListNum=0;
-	//char tmpGroupName[MAX_NAME_LEN], tmpListName[MAX_NAME_LEN], tmpItemName[MAX_NAME_LEN];
-	double tmpValue=0;
-  string oneline;
-  
-  //char **subwords;
-	double sgrnaProbValue=0.0;
-  int sgrnaChosen=1;
-  
-	ifstream fh;
-  vector<string> vwords;
-  vector<string> vsubwords;
-  int subWordNum=0;
-	
-  map<string,int> groupNames;
-  map<string,int> listNames;
-	//assert(tmpS!=NULL && tmpS2!=NULL);
-  if(getGroupListNum(fileName, groups, lists, maxGroupNum, maxListNum, tmpGroupNum, tmpListNum, groupNames, listNames)!=0){
+  const char *p = *pos;
+  const char *eol = (const char *)memchr(p, '\n', end-p);
+  int n = 0;
+
+  if (eol==NULL){
+    eol = end;
+  }
+  while (p<eol){
+    while (p<eol && IsFieldDelim(*p)) p++;
+    if (p>=eol) break;
+    const char *s = p;
+    while (p<eol && !IsFieldDelim(*p)) p++;
+    if (n<maxToken){
+      tokens[n].str = s;
+      tokens[n].len = (int)(p-s);
+    }
+    n++;
+  }
+  *pos = (eol<end)? eol+1 : end;
+  return n;
+}
+
+//parse a token as double without copying; behaves like atof (0.0 if not a number)
+static double TokenToDouble(const TOKEN &t)
+{
+  const char *s = t.str, *e = t.str+t.len;
+  double v = 0.0;
+  if (s<e && *s=='+') s++;
+  if (from_chars(s, e, v).ec!=errc()){
+    return 0.0;
+  }
+  return v;
+}
+
+//parse a token as int without copying; behaves like atoi (0 if not a number)
+static int TokenToInt(const TOKEN &t)
+{
+  const char *s = t.str, *e = t.str+t.len;
+  int v = 0;
+  if (s<e && *s=='+') s++;
+  if (from_chars(s, e, v).ec!=errc()){
+    return 0;
+  }
+  return v;
+}
+
+//grow a table of structs to hold at least num entries; capacity doubles. The count type is long for a table that may
+//outgrow an int
+template <class T, class N> static T *GrowTable(T *table, N num, N *maxNum)
+{
+  if (num<=*maxNum){
+    return table;
+  }
+  *maxNum = (*maxNum>0)? *maxNum*2 : 1024;
+  if (*maxNum<num){
+    *maxNum = num;
+  }
+  table = (T *)realloc(table, (size_t)(*maxNum)*sizeof(T));
+  assert(table!=NULL);
+  return table;
+}
+
+typedef struct // one input row, kept until the item arena is built
+{
+  unsigned int nameId;
+  int listIndex;
+  double value;
+  double prob;
+  int isChosen;
+} ROW_STRUCT;
+
+typedef struct // membership of an input row in a group
+{
+  int row;
+  int group;
+} MEMBER_STRUCT;
+
+//Allocate the parallel arrays of an item arena
+static void AllocItemArena(ITEM_ARENA *items, int itemNum)
+{
+  size_t n = (itemNum>0)? (size_t)itemNum : 1;
+  items->nameId = (unsigned int *)malloc(n*sizeof(unsigned int));
+  items->listIndex = (int *)malloc(n*sizeof(int));
+  items->value = (double *)malloc(n*sizeof(double));
+  items->percentile = (double *)malloc(n*sizeof(double));
+  items->prob = (double *)malloc(n*sizeof(double));
+  items->isChosen = (char *)malloc(n*sizeof(char));
+  items->origin = (int *)malloc(n*sizeof(int));
+  items->itemNum = itemNum;
+}
+
+//Release the memory of an item arena
+void FreeItemArena(ITEM_ARENA *items)
+{
+  free(items->nameId);
+  free(items->listIndex);
+  free(items->value);
+  free(items->percentile);
+  free(items->prob);
+  free(items->isChosen);
+  free(items->origin);
+  memset(items, 0, sizeof(ITEM_ARENA));
+}
+
+//copy an input row into item k of the arena
+static void SetItem(ITEM_ARENA *items, int k, const ROW_STRUCT *row, int origin)
+{
+  items->nameId[k] = row->nameId;
+  items->listIndex[k] = row->listIndex;
+  items->value[k] = row->value;
+  items->percentile[k] = -1.0;
+  items->prob[k] = row->prob;
+  items->isChosen[k] = (row->isChosen!=0);
+  items->origin[k] = origin;
+}
+
+//Lay out the parsed rows as an item arena with the items of each group stored contiguously, in input order.
+//Rows listed under several groups get one item per group; all copies share the origin of the first one.
+//Rows without any group are kept after the last group so that they still count in their list.
+//itemRow, if not NULL, receives the input row of each item
+static void BuildItemArena(ITEM_ARENA *items, const ROW_STRUCT *rows, int rowNum, const MEMBER_STRUCT *members, int memberNum,
+                           GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum, int *itemRow)
+{
+  int i,k,r;
+  int *rowFirst;
+  int *cursor;
+  int ungroupedNum;
+
+  //arena index of the first copy of each row
+  rowFirst = (int *)malloc(((size_t)rowNum+1)*sizeof(int));
+  for (i=0;i<rowNum;i++) rowFirst[i] = -1;
+
+  ungroupedNum = rowNum;
+  for (i=0;i<memberNum;i++){
+    if (rowFirst[members[i].row]<0){
+      rowFirst[members[i].row] = 0;
+      ungroupedNum--;
+    }
+  }
+  AllocItemArena(items, memberNum+ungroupedNum);
+
+  //group offsets from group sizes
+  cursor = (int *)malloc(((size_t)groupNum+1)*sizeof(int));
+  k = 0;
+  for (i=0;i<groupNum;i++){
+    groups[i].itemStart = k;
+    cursor[i] = k;
+    k += groups[i].itemNum;
+  }
+
+  for (i=0;i<rowNum;i++) rowFirst[i] = -1;
+  for (i=0;i<memberNum;i++){
+    r = members[i].row;
+    k = cursor[members[i].group]++;
+    if (rowFirst[r]<0) rowFirst[r] = k;
+    SetItem(items, k, rows+r, rowFirst[r]);
+    if (itemRow!=NULL) itemRow[k] = r;
+  }
+  k = memberNum;
+  for (i=0;i<rowNum;i++){
+    if (rowFirst[i]>=0) continue;
+    rowFirst[i] = k;
+    SetItem(items, k, rows+i, k);
+    if (itemRow!=NULL) itemRow[k] = i;
+    k++;
+  }
+
+  //each list refers to one copy of each chosen row
+  for (i=0;i<listNum;i++){
+    lists[i].items = (int *)malloc(((size_t)lists[i].itemNum+1)*sizeof(int));
+    lists[i].maxItemNum = lists[i].itemNum;
+    lists[i].itemNum = 0;
+  }
+  for (i=0;i<rowNum;i++){
+    if (!rows[i].isChosen) continue;
+    LIST_STRUCT *list = lists+rows[i].listIndex;
+    list->items[list->itemNum++] = rowFirst[i];
+  }
+
+  free(cursor);
+  free(rowFirst);
+}
+
+typedef struct // group, list, row and membership tables of the input, filled row by row
+{
+  GROUP_STRUCT *groups;
+  LIST_STRUCT *lists;
+  ROW_STRUCT *rows;
+  MEMBER_STRUCT *members;
+  int maxGroupNum, maxListNum, maxRowNum, maxMemberNum;
+  int groupNum, listNum, rowNum, memberNum;
+  int skippedNum;                //number of rows not chosen
+} INPUT_TABLES;
+
+static void InitInputTables(INPUT_TABLES *t)
+{
+  memset(t, 0, sizeof(INPUT_TABLES));
+}
+
+//add one input row: item name, group field, list name, value, probability and whether the row is chosen
+static void AddInputRow(INPUT_TABLES *t, const TOKEN &item, const TOKEN &group, const TOKEN &list,
+                        double value, double prob, int isChosen,
+                        NAME_POOL *itemNames, NAME_POOL *groupNames, NAME_POOL *listNames)
+{
+  int i,j;
+  int isNew;
+
+  if(isChosen==0) t->skippedNum+=1;
+
+  //search for the list index, creating a new list on first sight; list ids are list indexes
+  j = InternName(listNames, list.str, list.len, &isNew);
+  if (isNew){
+    t->listNum++;
+    t->lists = GrowTable(t->lists, t->listNum, &t->maxListNum);
+    t->lists[j].nameId = j;
+    t->lists[j].items = NULL;
+    t->lists[j].itemNum = 0;
+    t->lists[j].maxItemNum = 0;
+  }
+  if(isChosen){
+    t->lists[j].itemNum++;
+  }
+
+  t->rows = GrowTable(t->rows, t->rowNum+1, &t->maxRowNum);
+  t->rows[t->rowNum].nameId = InternName(itemNames, item.str, item.len, &isNew);
+  t->rows[t->rowNum].listIndex = j;
+  t->rows[t->rowNum].value = value;
+  t->rows[t->rowNum].prob = prob;
+  t->rows[t->rowNum].isChosen = isChosen;
+
+  //the group field may contain several group names separated by ","; group ids are group indexes
+  const char *g = group.str;
+  const char *gend = group.str+group.len;
+  while (g<gend){
+    const char *comma = (const char *)memchr(g, ',', gend-g);
+    if (comma==NULL) comma = gend;
+    if (comma>g){
+      i = InternName(groupNames, g, (int)(comma-g), &isNew);
+      if (isNew){
+        t->groupNum++;
+        t->groups = GrowTable(t->groups, t->groupNum, &t->maxGroupNum);
+        t->groups[i].nameId = i;
+        t->groups[i].itemStart = 0;
+        t->groups[i].itemNum = 0;
+      }
+      t->groups[i].itemNum++;
+      t->members = GrowTable(t->members, t->memberNum+1, &t->maxMemberNum);
+      t->members[t->memberNum].row = t->rowNum;
+      t->members[t->memberNum].group = i;
+      t->memberNum++;
+    }
+    g = comma+1;
+  }
+
+  t->rowNum++;
+}
+
+//build the item arena from the input tables and hand the group and list tables to the caller. Return the number of items.
+//itemRow, if not NULL, receives the input row of each item; it must hold one entry per row and per group membership
+static int FinishInputTables(INPUT_TABLES *t, ITEM_ARENA *items, GROUP_STRUCT **groupTable, int *groupNum,
+                             LIST_STRUCT **listTable, int *listNum, int *itemRow)
+{
+  BuildItemArena(items, t->rows, t->rowNum, t->members, t->memberNum, t->groups, t->groupNum, t->lists, t->listNum, itemRow);
+  free(t->rows);
+  free(t->members);
+
+  printf("Summary: %d sgRNAs, %d genes, %d lists; skipped sgRNAs:%d\n", t->rowNum, t->groupNum, t->listNum, t->skippedNum);
+
+  *groupTable = t->groups;
+  *groupNum = t->groupNum;
+  *listTable = t->lists;
+  *listNum = t->listNum;
+
+  return t->rowNum;
+}
+
+//Read input file in a single pass. File Format: <item id> <group id> <list id> <value>. Return the number of items if success, -1 if failure
+//A last line without a trailing newline is skipped, with a warning, as the getline loop of earlier versions did
+int ReadFile(const char *fileName, ITEM_ARENA *items, GROUP_STRUCT **groupTable, int *groupNum, 
+      LIST_STRUCT **listTable, int *listNum,
+      NAME_POOL *itemNames, NAME_POOL *groupNames, NAME_POOL *listNames)
+{
+  INPUT_TABLES tables;
+  MAPPED_FILE mf;
+  TOKEN words[6];
+  int wordNum;
+  double sgrnaProbValue;
+  int sgrnaChosen;
+
+  //an unreadable file is reported as an empty one, as by earlier versions
+  if (MapFile(fileName, &mf)!=0){
+    cerr<<"Error opening "<<fileName<<endl;
+    cerr<<"Error: incorrect input file format: <item id> <group id> <list id> <value> [<prob>] [iscounted]\n";
     return -1;
   }
-  // construct the structure
-	for (i=0;i<tmpGroupNum;i++){
-    //printf("Group %d items:%d\n",i,groups[i].itemNum);
-		groups[i].items = new ITEM_STRUCT[groups[i].itemNum];
-		groups[i].maxItemNum = groups[i].itemNum;
-		groups[i].itemNum = 0;
-	}
-	
-	for (i=0;i<tmpListNum;i++){
-    //printf("List %d items:%d\n",i,lists[i].itemNum);
-		lists[i].values = new double[lists[i].itemNum]; 
-		lists[i].maxItemNum = lists[i].itemNum;
-		lists[i].itemNum = 0;
-	}
-	
-  // actually loading the file
-  fh.open(fileName);
-  if(!fh.is_open()){
+
+  const char *pos = mf.data;
+  const char *end = mf.data+mf.size;
+
+  //Read the header row to get the sample number
+  wordNum = (pos<end)? NextLineTokens(&pos, end, words, 6) : 0;
+  if (wordNum < 4 || wordNum > 6){
+    cerr<<"Error: incorrect input file format: <item id> <group id> <list id> <value> [<prob>] [iscounted]\n";
+    UnmapFile(&mf);
+    return -1;
+  }
+
+  //read records of items
+  InitInputTables(&tables);
+  while (pos<end){
+    wordNum = NextLineTokens(&pos, end, words, 6);
+    if (wordNum<4){
+      break;
+    }
+    if (pos>=end && end[-1]!='\n'){
+      cerr<<"Warning: the last line of "<<fileName<<" has no trailing newline and is skipped.\n";
+      break;
+    }
+    //parsing prob column, if available
+    sgrnaProbValue = (wordNum > 4)? TokenToDouble(words[4]) : 1.0;
+    sgrnaChosen = (wordNum > 5)? TokenToInt(words[5]) : 1;
+
+    AddInputRow(&tables, words[0], words[1], words[2], TokenToDouble(words[3]), sgrnaProbValue, sgrnaChosen,
+                itemNames, groupNames, listNames);
+  }//end loop for file reading
+
+  UnmapFile(&mf);
+
+  return FinishInputTables(&tables, items, groupTable, groupNum, listTable, listNum, NULL);
+}
+
+//Read a matrix input file: the columns of ReadFile, with one value column per contrast named by the header. Columns
+//named prob and chosen hold the probability and the chosen flag of the rows, shared by all contrasts. The item arena
+//holds the values of the first contrast. Return the number of items if success, -1 if failure
+int ReadMatrixFile(const char *fileName, ITEM_ARENA *items, GROUP_STRUCT **groupTable, int *groupNum,
+      LIST_STRUCT **listTable, int *listNum,
+      NAME_POOL *itemNames, NAME_POOL *groupNames, NAME_POOL *listNames, CONTRAST_MATRIX *matrix)
+{
+  INPUT_TABLES tables;
+  MAPPED_FILE mf;
+  TOKEN *words;
+  int wordNum, columnNum;
+  int i, c, k, isNew;
+  int probColumn = -1, chosenColumn = -1;
+  int *contrastColumn;
+  double *rowValues = NULL;
+  long rowValueNum, maxRowValueNum = 0;  //rows times contrasts may exceed an int
+  int *itemRow;
+  int itemNum;
+
+  matrix->contrastNum = 0;
+  matrix->values = NULL;
+  InitNamePool(&matrix->contrastNames);
+
+  if (MapFile(fileName, &mf)!=0){
     cerr<<"Error opening "<<fileName<<endl;
+    FreeContrastMatrix(matrix);
+    return -1;
   }
-	
-	//Read the header row to get the sample number
-  getline(fh,oneline);
-	//fgets(tmpS, MAX_WORD_NUM*(MAX_NAME_LEN+1)*sizeof(char), fh);
-	
-	//read records of items
-	
-  getline(fh,oneline);
-  
-  wordNum=stringSplit(oneline," \t\r\n\v",vwords);
-  // fields saved to vwords: sgRNA name, gene name, list name, value
-	int skippedsgrna=0;
-	while ((wordNum>=4)&&(!fh.eof())){
-		//strcpy(tmpListName, words[2]);
-		tmpValue = atof(vwords[3].c_str());
-		//WL
-		//parsing prob column, if available
-		if (wordNum > 4){
-			sgrnaProbValue=atof(vwords[4].c_str());
-    }else{
-			sgrnaProbValue=1.0;
-		}
-		if (wordNum > 5){
-			sgrnaChosen=atoi(vwords[5].c_str());
-      if(sgrnaChosen==0) skippedsgrna+=1;
+
+  const char *pos = mf.data;
+  const char *end = mf.data+mf.size;
+
+  //the header names the columns after the list id
+  columnNum = 0;
+  if (pos<end){
+    const char *header = pos;
+    columnNum = NextLineTokens(&header, end, NULL, 0);
+  }
+  words = new TOKEN[columnNum+1];
+  contrastColumn = new int[columnNum+1];
+  if (pos<end){
+    NextLineTokens(&pos, end, words, columnNum);
+  }
+  for (i=3;i<columnNum;i++){
+    if (words[i].len==4 && memcmp(words[i].str, "prob", 4)==0){
+      probColumn = i;
+    }else if (words[i].len==6 && memcmp(words[i].str, "chosen", 6)==0){
+      chosenColumn = i;
     }else{
-			sgrnaChosen=1;
-		}
-
-
-		
-    //WL: now, search for corresponding list index
-    //for (j=0;j<tmpListNum;j++) if (!strcmp(vwords[2].c_str(), lists[j].name))	break;
-    string thislistname=vwords[2];
-    assert(listNames.count(thislistname)>0);
-    j=listNames[thislistname];
-    assert(j<tmpListNum);
-    // save to list
-    if(sgrnaChosen){
-		  lists[j].values[lists[j].itemNum] = tmpValue;
- 		  lists[j].itemNum ++;
-      assert(lists[j].itemNum <=lists[j].maxItemNum);
+      c = InternName(&matrix->contrastNames, words[i].str, words[i].len, &isNew);
+      if (!isNew){
+        cerr<<"Error: contrast "<<GetName(&matrix->contrastNames, c)<<" appears twice in the header of "<<fileName<<endl;
+        break;
+      }
+      contrastColumn[matrix->contrastNum++] = i;
     }
-    
-    //WL: search for gene name (group name)
-		// WL: separate the group name by ","
-    subWordNum=stringSplit(vwords[1],",",vsubwords);
-		assert(subWordNum>0);
-		//for(k=0;k<subWordNum;k++)
-	 for(k=0;k<subWordNum;k++) {
-  			//for (i=0;i<tmpGroupNum;i++)	if (!strcmp(vsubwords[k].c_str(), groups[i].name))	break;
-  		
-  		  assert(groupNames.count(vsubwords[k])>0);
-        i=groupNames[vsubwords[k]];
-  			assert(i<tmpGroupNum);
-  		
-        //save group name(gene name)
-  			//strcpy(groups[i].items[groups[i].itemNum].name,tmpItemName);
-  			strcpy(groups[i].items[groups[i].itemNum].name,vwords[0].c_str());
-  			groups[i].items[groups[i].itemNum].value = tmpValue;
-  			groups[i].items[groups[i].itemNum].prob= sgrnaProbValue;
-  			groups[i].items[groups[i].itemNum].listIndex = j;
-  			groups[i].items[groups[i].itemNum].isChosen= sgrnaChosen;
-  			groups[i].itemNum ++;
-      	assert(groups[i].itemNum <=groups[i].maxItemNum);
-  		
-    }//end subwordnum 
-		
-		totalItemNum++;
-		//wordNum = StringToWords(words, tmpS, MAX_NAME_LEN+1, MAX_WORD_NUM, " \t\r\n\v\f");
-    getline(fh,oneline);
-    wordNum=stringSplit(oneline," \t\r\f\v",vwords);
-   	//printf("wordnum:%d,read one line length:%d\n",wordNum,strlen(tmpS));
-	}//end loop for fh reading
-	
-	fh.close();
-	//fclose(fh);
-	
-	printf("Summary: %d sgRNAs, %d genes, %d lists; skipped sgRNAs:%d\n", totalItemNum, tmpGroupNum, tmpListNum,skippedsgrna);
-	
-	*groupNum = tmpGroupNum;
-	*listNum = tmpListNum;
-	
-	//FreeWords(words, MAX_WORD_NUM);
-	//free(tmpS);
-	//free(tmpS2);
-	//FreeWords(subwords, MAX_WORD_NUM);
-	
-	return totalItemNum;
-	
+  }
+  if ((i<columnNum)||(matrix->contrastNum==0)){
+    cerr<<"Error: incorrect matrix file format: <item id> <group id> <list id> <value of contrast 1> ... [prob] [chosen]\n";
+    UnmapFile(&mf);
+    delete []words;
+    delete []contrastColumn;
+    FreeContrastMatrix(matrix);
+    return -1;
+  }
+
+  //read records of items; the values of each row are kept until the item arena is built
+  InitInputTables(&tables);
+  while (pos<end){
+    wordNum = NextLineTokens(&pos, end, words, columnNum);
+    if (wordNum<columnNum){
+      break;
+    }
+    rowValueNum = (long)tables.rowNum*matrix->contrastNum;
+    rowValues = GrowTable(rowValues, rowValueNum+matrix->contrastNum, &maxRowValueNum);
+    for (c=0;c<matrix->contrastNum;c++){
+      rowValues[rowValueNum+c] = TokenToDouble(words[contrastColumn[c]]);
+    }
+    AddInputRow(&tables, words[0], words[1], words[2], rowValues[rowValueNum],
+                (probColumn>=0)? TokenToDouble(words[probColumn]) : 1.0, (chosenColumn>=0)? TokenToInt(words[chosenColumn]) : 1,
+                itemNames, groupNames, listNames);
+  }//end loop for file reading
+
+  UnmapFile(&mf);
+  delete []words;
+  delete []contrastColumn;
+
+  itemRow = (int *)malloc(((size_t)tables.rowNum+tables.memberNum+1)*sizeof(int));
+  itemNum = FinishInputTables(&tables, items, groupTable, groupNum, listTable, listNum, itemRow);
+
+  //the values of each contrast, laid out as the item arena
+  matrix->values = (double *)malloc(((size_t)items->itemNum*matrix->contrastNum+1)*sizeof(double));
+  for (c=0;c<matrix->contrastNum;c++){
+    for (k=0;k<items->itemNum;k++){
+      matrix->values[(long)c*items->itemNum+k] = rowValues[(long)itemRow[k]*matrix->contrastNum+c];
+    }
+  }
+  printf("Contrasts: %d\n", matrix->contrastNum);
+
+  free(itemRow);
+  free(rowValues);
+
+  return itemNum;
 }
 
-//Save group information to output file. Format <group id> <number of items in the group> <lo-value> <false discovery rate>
-int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum)
+//Release the memory of a contrast matrix
+void FreeContrastMatrix(CONTRAST_MATRIX *matrix)
+{
+  free(matrix->values);
+  FreeNamePool(&matrix->contrastNames);
+  matrix->values = NULL;
+  matrix->contrastNum = 0;
+}
+
+//Build the item arena and the group and list tables from rows held in memory, as ReadFile does for the rows of a file
+int LoadRows(int rowNum, const char *const *itemName, const char *const *groupName, const char *const *listName,
+             const double *value, const double *prob, const int *isChosen,
+             ITEM_ARENA *items, GROUP_STRUCT **groupTable, int *groupNum, LIST_STRUCT **listTable, int *listNum,
+             NAME_POOL *itemNames, NAME_POOL *groupNames, NAME_POOL *listNames)
+{
+  INPUT_TABLES tables;
+  int i;
+
+  InitInputTables(&tables);
+  for (i=0;i<rowNum;i++){
+    TOKEN item = {itemName[i], (int)strlen(itemName[i])};
+    TOKEN group = {groupName[i], (int)strlen(groupName[i])};
+    TOKEN list = {listName[i], (int)strlen(listName[i])};
+
+    AddInputRow(&tables, item, group, list, value[i], (prob!=NULL)? prob[i] : 1.0, (isChosen!=NULL)? isChosen[i] : 1,
+                itemNames, groupNames, listNames);
+  }
+
+  return FinishInputTables(&tables, items, groupTable, groupNum, listTable, listNum, NULL);
+}
+
+//Save group information to output file. Format <group id> <number of items in the group> <lo-value> <false discovery rate>, in the order given by order[]
+int SaveGroupInfo(const char *fileName, const GROUP_STRUCT *groups, const int *order, int groupNum, const NAME_POOL *groupNames)
 {
 	FILE *fh;
 	int i;
@@ -287,7 +557,8 @@ int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum)
 	fprintf(fh, "group_id\titems_in_group\tlo_value\tp\tFDR\tgoodsgrna\n");
 	
 	for (i=0;i<groupNum;i++){
-		fprintf(fh, "%s\t%d\t%10.4e\t%10.4e\t%f\t%d\n", groups[i].name, groups[i].itemNum, groups[i].loValue, groups[i].pvalue,groups[i].fdr,groups[i].goodsgrnas);
+		const GROUP_STRUCT *group = groups+order[i];
+		fprintf(fh, "%s\t%d\t%10.4e\t%10.4e\t%f\t%d\n", GetName(groupNames, group->nameId), group->itemNum, group->loValue, group->pvalue,group->fdr,group->goodsgrnas);
 	}
 	
 	fclose(fh);
@@ -295,4 +566,105 @@ int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum)
 	return 1;
 }
 
+//Print a value the way mageck printed the merged RRA results: rounded as in the RRA output file (format), then written
+//as Python writes a float, with 12 significant digits and ".0" after an integral value
+static void PrintSummaryValue(FILE *fh, double value, const char *format)
+{
+  char buf[64];
+
+  snprintf(buf, sizeof(buf), format, value);
+  snprintf(buf, sizeof(buf), "%.12g", atof(buf));
+  if (strpbrk(buf, ".eni")==NULL){
+    strcat(buf, ".0");
+  }
+  fputs(buf, fh);
+}
+
+//Save the groups of both directions of a dual-tail analysis in the format of the gene summary of mageck
+int SaveDualTailSummary(const char *fileName, const GROUP_STRUCT *negGroups, const int *negOrder, const GROUP_STRUCT *posGroups,
+                        const int *posOrder, int groupNum, const NAME_POOL *groupNames, bool sortByPos)
+{
+  FILE *fh;
+  int i;
+  int *negRank, *posRank;
+  const int *order = sortByPos? posOrder : negOrder;
+
+  fh = (FILE *)fopen(fileName, "w");
 
+  if (!fh){
+    printf("Cannot open %s.\n", fileName);
+    return -1;
+  }
+
+  negRank = new int[groupNum];
+  posRank = new int[groupNum];
+  for (i=0;i<groupNum;i++){
+    negRank[negOrder[i]] = i+1;
+    posRank[posOrder[i]] = i+1;
+  }
+
+  fprintf(fh, "id\tnum\tlo.neg\tp.neg\tfdr.neg\trank.neg\tgoodsgrna.neg\tlo.pos\tp.pos\tfdr.pos\trank.pos\tgoodsgrna.pos\n");
+
+  //the output order of a direction is by lo-value, which is also the order of the rounded lo-values mageck sorted by
+  for (i=0;i<groupNum;i++){
+    const GROUP_STRUCT *neg = negGroups+order[i];
+    const GROUP_STRUCT *pos = posGroups+order[i];
+
+    fprintf(fh, "%s\t%d\t", GetName(groupNames, neg->nameId), neg->itemNum);
+    PrintSummaryValue(fh, neg->loValue, "%10.4e");
+    fputc('\t', fh);
+    PrintSummaryValue(fh, neg->pvalue, "%10.4e");
+    fputc('\t', fh);
+    PrintSummaryValue(fh, neg->fdr, "%f");
+    fprintf(fh, "\t%d\t%d\t", negRank[order[i]], neg->goodsgrnas);
+    PrintSummaryValue(fh, pos->loValue, "%10.4e");
+    fputc('\t', fh);
+    PrintSummaryValue(fh, pos->pvalue, "%10.4e");
+    fputc('\t', fh);
+    PrintSummaryValue(fh, pos->fdr, "%f");
+    fprintf(fh, "\t%d\t%d\n", posRank[order[i]], pos->goodsgrnas);
+  }
+
+  fclose(fh);
+  delete []negRank;
+  delete []posRank;
+
+  return 1;
+}
+
+//Save the groups of every contrast of a matrix input, in the order of the first contrast
+int SaveMatrixSummary(const char *fileName, const GROUP_STRUCT *contrastGroups, const int *contrastOrder, int groupNum,
+                      const NAME_POOL *groupNames, const CONTRAST_MATRIX *matrix)
+{
+  FILE *fh;
+  int i, c;
+
+  fh = (FILE *)fopen(fileName, "w");
+
+  if (!fh){
+    printf("Cannot open %s.\n", fileName);
+    return -1;
+  }
+
+  fprintf(fh, "group_id\titems_in_group");
+  for (c=0;c<matrix->contrastNum;c++){
+    const char *name = GetName(&matrix->contrastNames, c);
+    fprintf(fh, "\t%s.lo_value\t%s.p\t%s.FDR\t%s.goodsgrna", name, name, name, name);
+  }
+  fprintf(fh, "\n");
+
+  for (i=0;i<groupNum;i++){
+    int g = contrastOrder[i];
+
+    fprintf(fh, "%s\t%d", GetName(groupNames, contrastGroups[g].nameId), contrastGroups[g].itemNum);
+    for (c=0;c<matrix->contrastNum;c++){
+      const GROUP_STRUCT *group = contrastGroups+(long)c*groupNum+g;
+      fprintf(fh, "\t%10.4e\t%10.4e\t%f\t%d", group->loValue, group->pvalue, group->fdr, group->goodsgrnas);
+    }
+    fprintf(fh, "\n");
+  }
+
+  fclose(fh);
+
+  return 1;
+}
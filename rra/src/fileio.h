@@ -3,11 +3,50 @@
 
 #include "classdef.h"
 
-//Read input file. File Format: <item id> <group id> <list id> <value>. Return 1 if success, -1 if failure
-int ReadFile(char *fileName, GROUP_STRUCT *groups, int maxGroupNum, int *groupNum, LIST_STRUCT *lists, int maxListNum, int *listNum);
-
-//Save group information to output file. Format <group id> <number of items in the group> <lo-value> <false discovery rate>
-int SaveGroupInfo(char *fileName, GROUP_STRUCT *groups, int groupNum);
+//Read input file in a single pass over a memory-mapped view. File Format: <item id> <group id> <list id> <value>. Return the number of items if success, -1 if failure
+//A last line without a trailing newline is skipped, with a warning, as by earlier versions.
+//Item, group and list names are interned into itemNames, groupNames and listNames.
+//The group and list tables are allocated by ReadFile and grow with the data; release them with free()
+//Items are stored in the item arena; release it with FreeItemArena()
+int ReadFile(const char *fileName, ITEM_ARENA *items, GROUP_STRUCT **groups, int *groupNum, LIST_STRUCT **lists, int *listNum,
+             NAME_POOL *itemNames, NAME_POOL *groupNames, NAME_POOL *listNames);
+
+//Read a matrix input file: the columns of ReadFile, with one value column per contrast named by the header
+//(<item id> <group id> <list id> <value of contrast 1> ... <value of contrast K>). Columns named prob and chosen hold the
+//probability and the chosen flag of the rows, shared by all contrasts. The item arena, group and list tables are built
+//once, as by ReadFile, with the values of the first contrast; matrix receives the values of every contrast.
+//Release it with FreeContrastMatrix(). Return the number of items if success, -1 if failure
+int ReadMatrixFile(const char *fileName, ITEM_ARENA *items, GROUP_STRUCT **groups, int *groupNum, LIST_STRUCT **lists, int *listNum,
+                   NAME_POOL *itemNames, NAME_POOL *groupNames, NAME_POOL *listNames, CONTRAST_MATRIX *matrix);
+
+//Release the memory of a contrast matrix
+void FreeContrastMatrix(CONTRAST_MATRIX *matrix);
+
+//Build the item arena and the group and list tables from rows held in memory, as ReadFile does for the rows of a file.
+//Row i is item itemName[i] of list listName[i] with value[i], in the groups of groupName[i] (several separated by ",").
+//prob and isChosen may be NULL for probability 1 and all rows chosen. Return the number of items, -1 if failure
+int LoadRows(int rowNum, const char *const *itemName, const char *const *groupName, const char *const *listName,
+             const double *value, const double *prob, const int *isChosen,
+             ITEM_ARENA *items, GROUP_STRUCT **groups, int *groupNum, LIST_STRUCT **lists, int *listNum,
+             NAME_POOL *itemNames, NAME_POOL *groupNames, NAME_POOL *listNames);
+
+//Release the memory of an item arena
+void FreeItemArena(ITEM_ARENA *items);
+
+//Save group information to output file. Format <group id> <number of items in the group> <lo-value> <false discovery rate>, in the order given by order[]
+int SaveGroupInfo(const char *fileName, const GROUP_STRUCT *groups, const int *order, int groupNum, const NAME_POOL *groupNames);
+
+//Save the groups of both directions of a dual-tail analysis in the format of the gene summary of mageck:
+//<id> <num> <lo.neg> <p.neg> <fdr.neg> <rank.neg> <goodsgrna.neg> <lo.pos> <p.pos> <fdr.pos> <rank.pos> <goodsgrna.pos>,
+//in the order of the negative selection, or of the positive selection if sortByPos. Return 1 if success, -1 if failure
+int SaveDualTailSummary(const char *fileName, const GROUP_STRUCT *negGroups, const int *negOrder, const GROUP_STRUCT *posGroups,
+                        const int *posOrder, int groupNum, const NAME_POOL *groupNames, bool sortByPos);
+
+//Save the groups of every contrast of a matrix input: <group id> <number of items in the group>, followed by
+//<lo-value> <p> <FDR> <goodsgrna> of each contrast; contrastGroups and contrastOrder hold groupNum entries per contrast.
+//Groups are in the order of the first contrast. Return 1 if success, -1 if failure
+int SaveMatrixSummary(const char *fileName, const GROUP_STRUCT *contrastGroups, const int *contrastOrder, int groupNum,
+                      const NAME_POOL *groupNames, const CONTRAST_MATRIX *matrix);
 
 
 
@@ -0,0 +1,228 @@
+/*
+ *  librra.cpp
+ *  C interface of the RRA library: the analysis of the RRA command on rows held in memory
+ *
+ */
+
+#include <string.h>
+#include <iostream>
+#include <mutex>
+using namespace std;
+
+#include "classdef.h"
+#include "fileio.h"
+#include "threadpool.h"
+#include "rngs.h"
+#include "rracore.h"
+#include "librra.h"
+
+static_assert((RRA_LOVALUE_ORDERSTAT==LOVALUE_ORDERSTAT)&&(RRA_LOVALUE_BETAIN==LOVALUE_BETAIN), "lo-value methods");
+static_assert((RRA_RNG_LEHMER==RNG_LEHMER)&&(RRA_RNG_PHILOX==RNG_PHILOX), "random generators");
+static_assert((RRA_PVALUE_PERMUTATION==PVALUE_PERMUTATION)&&(RRA_PVALUE_EXACT==PVALUE_EXACT), "p-value methods");
+
+//the worker pool is process-wide: the first of overlapping RraRun calls starts it and the last one stops it
+static std::mutex poolUsersMutex;
+static int poolUsers = 0;
+
+static void AcquireThreadPool(int threadNum)
+{
+	std::lock_guard<std::mutex> lock(poolUsersMutex);
+	if (poolUsers++==0){
+		InitThreadPool(threadNum);
+	}
+}
+
+static void ReleaseThreadPool(void)
+{
+	std::lock_guard<std::mutex> lock(poolUsersMutex);
+	if (--poolUsers==0){
+		FreeThreadPool();
+	}
+}
+
+//Fill in the defaults of the RRA command
+void RraDefaultOptions(RRA_OPTIONS *options)
+{
+	options->maxPercentile = 0.1;
+	options->threadNum = 0;
+	options->loValueMethod = RRA_LOVALUE_ORDERSTAT;
+	options->rngMethod = RRA_RNG_PHILOX;
+	options->pvalueMethod = RRA_PVALUE_PERMUTATION;
+	options->minPValue = 0.0;
+	options->pvalueError = 0.0;
+	options->nullCacheDir = NULL;
+	options->controlNames = NULL;
+	options->controlNum = 0;
+}
+
+//copy the groups in output order into the arrays of a result
+static void FillResult(RRA_RESULT *result, const GROUP_STRUCT *groups, const int *order, int groupNum, const NAME_POOL *groupNames)
+{
+	int i;
+	size_t charNum = 0;
+	char *chars;
+	
+	for (i=0;i<groupNum;i++){
+		charNum += strlen(GetName(groupNames, groups[i].nameId))+1;
+	}
+	result->groupNum = groupNum;
+	result->name = (const char **)malloc(((size_t)groupNum+1)*sizeof(const char *));
+	result->itemNum = (int *)malloc(((size_t)groupNum+1)*sizeof(int));
+	result->loValue = (double *)malloc(((size_t)groupNum+1)*sizeof(double));
+	result->pvalue = (double *)malloc(((size_t)groupNum+1)*sizeof(double));
+	result->fdr = (double *)malloc(((size_t)groupNum+1)*sizeof(double));
+	result->goodsgrna = (int *)malloc(((size_t)groupNum+1)*sizeof(int));
+	result->nameChars = (char *)malloc(charNum+1);
+	
+	chars = result->nameChars;
+	for (i=0;i<groupNum;i++){
+		const GROUP_STRUCT *group = groups+order[i];
+		const char *name = GetName(groupNames, group->nameId);
+		
+		strcpy(chars, name);
+		result->name[i] = chars;
+		chars += strlen(name)+1;
+		result->itemNum[i] = group->itemNum;
+		result->loValue[i] = group->loValue;
+		result->pvalue[i] = group->pvalue;
+		result->fdr[i] = group->fdr;
+		result->goodsgrna[i] = group->goodsgrnas;
+	}
+}
+
+//Load the rows and run one direction (posResult==NULL) or both directions of the rank aggregation; with both, the
+//merged summary is saved to summaryFileName unless it is NULL. result and posResult may be NULL to skip filling them
+static int RunRows(const RRA_OPTIONS *options, double posMaxPercentile, int rowNum, const char *const *itemName,
+				   const char *const *groupName, const char *const *listName, const double *value, const double *prob,
+				   const int *isChosen, bool dualTail, const char *summaryFileName, bool sortByPos, RRA_RESULT *result,
+				   RRA_RESULT *posResult)
+{
+	int i, flag;
+	GROUP_STRUCT *groups=NULL;
+	LIST_STRUCT *lists=NULL;
+	int *groupOrder=NULL;
+	GROUP_STRUCT *posGroups=NULL;
+	int *posOrder=NULL;
+	int groupNum=0, listNum=0;
+	NAME_POOL itemNames, groupNames, listNames;
+	ITEM_ARENA items;
+	RRA_CONTEXT context;
+	int isNew;
+	
+	if (result!=NULL){
+		memset(result, 0, sizeof(RRA_RESULT));
+	}
+	if (posResult!=NULL){
+		memset(posResult, 0, sizeof(RRA_RESULT));
+	}
+	if ((options->maxPercentile>1.0)||(options->maxPercentile<0.0)||(dualTail&&((posMaxPercentile>1.0)||(posMaxPercentile<0.0))))
+	{
+		cerr<<("Error: maxPercentile should be within 0.0 and 1.0\n");
+		return -1;
+	}
+	if ((options->minPValue<0.0)||(options->minPValue>=1.0)||(options->pvalueError<0.0))
+	{
+		cerr<<("Error: minPValue should be within 0.0 and 1.0, and pvalueError positive\n");
+		return -1;
+	}
+	
+	InitRraContext(&context);
+	context.loValueMethod = options->loValueMethod;
+	context.rngMethod = options->rngMethod;
+	context.pvalueMethod = options->pvalueMethod;
+	context.minPValue = options->minPValue;
+	context.pvalueRelError = options->pvalueError;
+	context.nullCacheDir = options->nullCacheDir;
+	context.useControlSeq = (options->controlNames!=NULL);
+	if (context.useControlSeq){
+		InitNamePool(&context.controlSeqNames);
+	}
+	for (i=0;(i<options->controlNum)&&context.useControlSeq;i++){
+		if (options->controlNames[i][0]!=0){
+			InternName(&context.controlSeqNames, options->controlNames[i], (int)strlen(options->controlNames[i]), &isNew);
+		}
+	}
+	
+	AcquireThreadPool(options->threadNum);
+	InitNamePool(&itemNames);
+	InitNamePool(&groupNames);
+	InitNamePool(&listNames);
+	
+	flag = LoadRows(rowNum, itemName, groupName, listName, value, prob, isChosen,
+					&items, &groups, &groupNum, &lists, &listNum, &itemNames, &groupNames, &listNames);
+	if ((flag<=0)||(groupNum==0)){
+		cerr<<"\nError: no ranked items in any group ...\n";
+		flag = -1;
+	}
+	
+	if (flag>0){
+		groupOrder = new int[groupNum];
+		if (dualTail){
+			posGroups = new GROUP_STRUCT[groupNum];
+			posOrder = new int[groupNum];
+			flag = RunDualTailRRA(&context, &items, groups, posGroups, groupNum, lists, listNum, options->maxPercentile,
+								  posMaxPercentile, &itemNames, groupOrder, posOrder);
+		}else{
+			flag = RunRRA(&context, &items, groups, groupNum, lists, listNum, options->maxPercentile, &itemNames, groupOrder);
+		}
+	}
+	if ((flag>0)&&dualTail&&(summaryFileName!=NULL)){
+		flag = SaveDualTailSummary(summaryFileName, groups, groupOrder, posGroups, posOrder, groupNum, &groupNames, sortByPos);
+	}
+	if (flag>0){
+		if (result!=NULL){
+			FillResult(result, groups, groupOrder, groupNum, &groupNames);
+		}
+		if (posResult!=NULL){
+			FillResult(posResult, posGroups, posOrder, groupNum, &groupNames);
+		}
+	}
+	
+	free(groups);
+	delete []groupOrder;
+	delete []posGroups;
+	delete []posOrder;
+	for (i=0;i<listNum;i++)
+	{
+		free(lists[i].items);
+	}
+	free(lists);
+	FreeItemArena(&items);
+	ReleaseThreadPool();
+	FreeNamePool(&itemNames);
+	FreeNamePool(&groupNames);
+	FreeNamePool(&listNames);
+	FreeRraContext(&context);
+	
+	return (flag>0)? 1 : -1;
+}
+
+//Rank aggregation of rowNum ranked items held in memory
+int RraRun(const RRA_OPTIONS *options, int rowNum, const char *const *itemName, const char *const *groupName,
+		   const char *const *listName, const double *value, const double *prob, const int *isChosen, RRA_RESULT *result)
+{
+	return RunRows(options, 0.0, rowNum, itemName, groupName, listName, value, prob, isChosen, false, NULL, false, result, NULL);
+}
+
+//Rank aggregation of rowNum ranked items held in memory, in both directions
+int RraRunDualTail(const RRA_OPTIONS *options, double posMaxPercentile, int rowNum, const char *const *itemName,
+				   const char *const *groupName, const char *const *listName, const double *value, const double *prob,
+				   const int *isChosen, const char *summaryFileName, int sortByPos, RRA_RESULT *negResult,
+				   RRA_RESULT *posResult)
+{
+	return RunRows(options, posMaxPercentile, rowNum, itemName, groupName, listName, value, prob, isChosen, true,
+				   summaryFileName, sortByPos!=0, negResult, posResult);
+}
+
+//Release the arrays of a result
+void RraFreeResult(RRA_RESULT *result)
+{
+	free(result->name);
+	free(result->itemNum);
+	free(result->loValue);
+	free(result->pvalue);
+	free(result->fdr);
+	free(result->goodsgrna);
+	free(result->nameChars);
+	memset(result, 0, sizeof(RRA_RESULT));
+}
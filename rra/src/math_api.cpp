@@ -10,8 +10,12 @@
 #include <math.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include "math_api.h"
 #include "rvgs.h"
+#include "threadpool.h"
 
 // normalInv: from Ziegler's code
 double normalInv(double p);
@@ -25,6 +29,21 @@ double LogGamma(double x, int *flag);
 //Compute incomplete beta function ratio
 double betain (double x, double p, double q, double beta, int *ifault);
 
+//Tables shared by all BetaIntegerCdf and OrderStatisticCdf calls, of every analysis in the process
+typedef struct LOG_TABLES_S
+{
+	double *logGamma;              //LogGamma(k) for k=1..gammaSize-1
+	int gammaSize;
+	double *logFact;               //log(k!) for k=0..factSize-1
+	int factSize;
+	struct LOG_TABLES_S *replaced; //smaller tables replaced by these ones, kept until the last user is done
+} LOG_TABLES;
+
+static LOG_TABLES emptyLogTables = {NULL, 0, NULL, 0, NULL};
+static std::atomic<const LOG_TABLES *> logTables(&emptyLogTables);  //the largest tables built, only growing while in use
+static std::mutex logTablesMutex;                                   //protects the building and release of the tables
+static int logTablesUsers = 0;                                      //InitBetaIntegerCdf calls not yet released
+
 //BTreeSearchingF: Searching value in array, which was organized in ascending order previously
 int  bTreeSearchingF(double value, double *a, int lo, int hi)
 {
@@ -60,78 +79,281 @@ int  bTreeSearchingF(double value, double *a, int lo, int hi)
 	}
 }
 
-//Quicksort an array in real values, in ascending order
-void QuicksortF(double *a, int lo, int hi)
+#define INSERTION_SORT_MAX 16      //partitions up to this size are finished by insertion sort
+#define RADIX_SORT_MIN 65536        //arrays from this size on are radix sorted
+#define RADIX_BITS 11               //bits per radix digit
+#define RADIX_BUCKETS (1<<RADIX_BITS)
+#define RADIX_PASSES 6              //ceil(64/RADIX_BITS)
+
+static inline bool LessF(const double &x, const double &y)
+{
+	return x<y;
+}
+
+static inline bool LessIndexed(const INDEXED_FLOAT &x, const INDEXED_FLOAT &y)
 {
-	int i=lo, j=hi;
-	double x=a[(lo+hi)/2];
-	double h;
+	return x.value<y.value;
+}
+
+template <class T, class Less> static void InsertionSort(T *a, int lo, int hi, Less less)
+{
+	int i,j;
 	
-	if (hi<lo)
-	{
-		return;
+	for (i=lo+1;i<=hi;i++){
+		T h = a[i];
+		for (j=i;j>lo && less(h, a[j-1]);j--){
+			a[j] = a[j-1];
+		}
+		a[j] = h;
 	}
+}
+
+template <class T, class Less> static void SiftDown(T *a, int root, int n, Less less)
+{
+	T h = a[root];
+	int child;
 	
-    //  partition
-    while (i<=j)
-    {    
-		while ((a[i]<x)&&(i<=j))
-		{
-			i++;
+	while ((child = 2*root+1)<n){
+		if (child+1<n && less(a[child], a[child+1])){
+			child++;
 		}
-		while ((a[j]>x)&&(i<=j))
-		{
-			j--;
+		if (!less(h, a[child])){
+			break;
 		}
-        if (i<=j)
-        {
-			h = a[i];
-			a[i] = a[j];
-			a[j] = h;
-            i++; j--;
-        }
-    } 
+		a[root] = a[child];
+		root = child;
+	}
+	a[root] = h;
+}
+
+template <class T, class Less> static void HeapSort(T *a, int n, Less less)
+{
+	int i;
 	
-    //  recursion
-    if (lo<j) QuicksortF(a, lo, j);
-    if (i<hi) QuicksortF(a, i, hi);
+	for (i=n/2-1;i>=0;i--){
+		SiftDown(a, i, n, less);
+	}
+	for (i=n-1;i>0;i--){
+		T h = a[0];
+		a[0] = a[i];
+		a[i] = h;
+		SiftDown(a, 0, i, less);
+	}
 }
 
-//Quicksort an indexed array, in ascending order 
-void QuicksortIndexedArray(INDEXED_FLOAT *a, int lo, int hi)
+//Introspective quicksort, robust to ties and presorted input. The pivot is a median of three, so sorted and reversed
+//runs split evenly. When the pivot equals the key just left of the range (a lower bound of the whole range), all keys
+//equal to it are gathered in one pass and dropped, so runs of ties cost linear time. Partitions that still recurse
+//too deep fall back to heapsort
+template <class T, class Less> static void IntroSort(T *a, int lo, int hi, int depth, bool leftmost, Less less)
 {
-	int i=lo, j=hi;
-	double x=a[(lo+hi)/2].value;
-	INDEXED_FLOAT h;
+	while (hi-lo+1>INSERTION_SORT_MAX){
+		if (depth==0){
+			HeapSort(a+lo, hi-lo+1, less);
+			return;
+		}
+		depth--;
+		
+		int mid = lo+(hi-lo)/2;
+		if (less(a[mid], a[lo])) std::swap(a[mid], a[lo]);
+		if (less(a[hi], a[lo])) std::swap(a[hi], a[lo]);
+		if (less(a[hi], a[mid])) std::swap(a[hi], a[mid]);
+		T pivot = a[mid];
+		int i, j;
+		
+		if (!leftmost && !less(a[lo-1], pivot)){
+			//every key here is >= a[lo-1] == pivot: move the keys equal to the pivot to the front and skip them
+			j = lo;
+			for (i=lo;i<=hi;i++){
+				if (!less(pivot, a[i])){
+					std::swap(a[i], a[j++]);
+				}
+			}
+			lo = j;
+			continue;
+		}
+		
+		//partition: a[lo..j] <= pivot, a[i..hi] >= pivot
+		i = lo;
+		j = hi;
+		while (i<=j){
+			while (less(a[i], pivot) && i<=j) i++;
+			while (less(pivot, a[j]) && i<=j) j--;
+			if (i<=j){
+				std::swap(a[i], a[j]);
+				i++;
+				j--;
+			}
+		}
+		
+		//recurse into the smaller side, loop on the larger one
+		if (j-lo<hi-i){
+			IntroSort(a, lo, j, depth, leftmost, less);
+			lo = i;
+			leftmost = false;
+		}
+		else{
+			IntroSort(a, i, hi, depth, false, less);
+			hi = j;
+		}
+	}
+	InsertionSort(a, lo, hi, less);
+}
+
+template <class T, class Less> static void IntroSort(T *a, int lo, int hi, Less less)
+{
+	int depth = 0;
+	int n;
 	
-	if (hi<lo)
-	{
-		return;
+	for (n=hi-lo+1;n>1;n>>=1){
+		depth += 2;
 	}
+	IntroSort(a, lo, hi, depth, true, less);
+}
+
+//Stable merge sort: runs of INSERTION_SORT_MAX keys are insertion sorted, then merged bottom-up through a buffer.
+//Equal keys keep their input order, as in the radix sort, so the order of ties does not depend on the array size
+template <class T, class Less> static void MergeSort(T *a, int n, Less less)
+{
+	int lo, width, i;
+	T *buf = new T[n];
+	T *src = a, *dest = buf;
 	
-    //  partition
-    while (i<=j)
-    {    
-		while ((a[i].value<x)&&(i<=j))
-		{
-			i++;
+	for (lo=0;lo<n;lo+=INSERTION_SORT_MAX){
+		InsertionSort(a, lo, std::min(n, lo+INSERTION_SORT_MAX)-1, less);
+	}
+	for (width=INSERTION_SORT_MAX;width<n;width*=2){
+		for (lo=0;lo<n;lo+=2*width){
+			int mid = std::min(n, lo+width), hi = std::min(n, lo+2*width);
+			int l = lo, r = mid;
+			
+			//a key of the right run only goes first if it is strictly smaller
+			for (i=lo;i<hi;i++){
+				dest[i] = ((r<hi) && (l>=mid || less(src[r], src[l])))? src[r++] : src[l++];
+			}
 		}
-		while ((a[j].value>x)&&(i<=j))
-		{
-			j--;
+		std::swap(src, dest);
+	}
+	
+	if (src!=a){
+		memcpy(a, src, (size_t)n*sizeof(T));
+	}
+	delete[] buf;
+}
+
+//Unsigned key that orders like the double value
+static inline unsigned long long SortKey(double v)
+{
+	unsigned long long u;
+	
+	memcpy(&u, &v, sizeof(u));
+	return (u>>63)? ~u : (u|0x8000000000000000ULL);
+}
+
+static inline unsigned long long SortKey(const INDEXED_FLOAT &x)
+{
+	return SortKey(x.value);
+}
+
+//Stable LSD radix sort. Every pass counts digits per chunk in parallel, then each chunk scatters its own slice
+template <class T> static void RadixSort(T *a, int n)
+{
+	int chunkNum = ThreadPoolSize()*4;
+	int chunkSize = (n+chunkNum-1)/chunkNum;
+	T *buf = new T[n];
+	T *src = a, *dest = buf;
+	int *counts = new int[(size_t)chunkNum*RADIX_BUCKETS];
+	int pass;
+	
+	for (pass=0;pass<RADIX_PASSES;pass++){
+		int shift = pass*RADIX_BITS;
+		
+		ParallelFor(chunkNum, [&](int c, int threadId){
+			int *cnt = counts+(size_t)c*RADIX_BUCKETS;
+			int i, end = std::min(n, (c+1)*chunkSize);
+			memset(cnt, 0, RADIX_BUCKETS*sizeof(int));
+			for (i=c*chunkSize;i<end;i++){
+				cnt[(SortKey(src[i])>>shift)&(RADIX_BUCKETS-1)]++;
+			}
+		});
+		
+		//skip passes where all keys share the digit
+		bool trivial = false;
+		int b, c;
+		for (b=0;b<RADIX_BUCKETS && !trivial;b++){
+			int total = 0;
+			for (c=0;c<chunkNum;c++) total += counts[(size_t)c*RADIX_BUCKETS+b];
+			if (total==n) trivial = true;
+			else if (total>0) break;
+		}
+		if (trivial){
+			continue;
 		}
-        if (i<=j)
-        {
-			memcpy(&h, a+i, sizeof(INDEXED_FLOAT));
-			memcpy(a+i,a+j,sizeof(INDEXED_FLOAT));
-			memcpy(a+j, &h, sizeof(INDEXED_FLOAT));
-            i++; j--;
-        }
-    } 
+		
+		//exclusive prefix sums, bucket-major then chunk-major, so that the sort stays stable
+		int offset = 0;
+		for (b=0;b<RADIX_BUCKETS;b++){
+			for (c=0;c<chunkNum;c++){
+				int h = counts[(size_t)c*RADIX_BUCKETS+b];
+				counts[(size_t)c*RADIX_BUCKETS+b] = offset;
+				offset += h;
+			}
+		}
+		
+		ParallelFor(chunkNum, [&](int c, int threadId){
+			int *cnt = counts+(size_t)c*RADIX_BUCKETS;
+			int i, end = std::min(n, (c+1)*chunkSize);
+			for (i=c*chunkSize;i<end;i++){
+				dest[cnt[(SortKey(src[i])>>shift)&(RADIX_BUCKETS-1)]++] = src[i];
+			}
+		});
+		std::swap(src, dest);
+	}
 	
-    //  recursion
-    if (lo<j) QuicksortIndexedArray(a, lo, j);
-    if (i<hi) QuicksortIndexedArray(a, i, hi);
+	if (src!=a){
+		memcpy(a, src, (size_t)n*sizeof(T));
+	}
+	delete[] counts;
+	delete[] buf;
+}
+
+//Quicksort an array in real values, in ascending order
+void QuicksortF(double *a, int lo, int hi)
+{
+	if (hi>lo){
+		IntroSort(a, lo, hi, LessF);
+	}
+}
+
+//Quicksort an indexed array, in ascending order 
+void QuicksortIndexedArray(INDEXED_FLOAT *a, int lo, int hi)
+{
+	if (hi>lo){
+		IntroSort(a, lo, hi, LessIndexed);
+	}
+}
+
+//Sort an array in real values, in ascending order. Large arrays use a parallel radix sort
+void SortF(double *a, int n)
+{
+	if (n>=RADIX_SORT_MIN){
+		RadixSort(a, n);
+	}
+	else{
+		QuicksortF(a, 0, n-1);
+	}
+}
+
+//Sort an indexed array by value, in ascending order. The sort is stable at every size: large arrays use a parallel
+//radix sort, small ones a merge sort
+void SortIndexedArray(INDEXED_FLOAT *a, int n)
+{
+	if (n>=RADIX_SORT_MIN){
+		RadixSort(a, n);
+	}
+	else if (n>1){
+		MergeSort(a, n, LessIndexed);
+	}
 }
 
 //Normal score transform
@@ -577,6 +799,12 @@ double BetaNoncentralCdf ( double a, double b, double lambda, double x, double e
 	
 	bi = betain ( x, a, b, beta_log, &ifault );
 	
+	//central beta distribution: the series below has a single term
+	if ( lambda == 0.0 )
+	{
+		return bi;
+	}
+	
 	si = exp (
 			  a * log ( x )
 			  + b * log ( 1.0 - x )
@@ -606,3 +834,348 @@ double BetaNoncentralCdf ( double a, double b, double lambda, double x, double e
 	return value;
 }
 
+
+//Build the cached tables used by BetaIntegerCdf and OrderStatisticCdf, covering groups of up to maxNum items.
+//Each call is paired with a FreeBetaIntegerCdf; analyses running at the same time share the tables
+void InitBetaIntegerCdf(int maxNum)
+{
+	const LOG_TABLES *current;
+	LOG_TABLES *t;
+	int k, flag;
+	
+	std::lock_guard<std::mutex> lock(logTablesMutex);
+	logTablesUsers++;
+	current = logTables.load(std::memory_order_relaxed);
+	if (maxNum+2<=current->gammaSize)
+	{
+		return;
+	}
+	
+	//readers may still hold the current tables, so they are replaced rather than freed
+	t = (LOG_TABLES *)malloc(sizeof(LOG_TABLES));
+	t->gammaSize = maxNum+2;
+	t->logGamma = (double *)malloc(t->gammaSize*sizeof(double));
+	t->factSize = maxNum+1;
+	t->logFact = (double *)malloc(t->factSize*sizeof(double));
+	t->replaced = (current==&emptyLogTables) ? NULL : (LOG_TABLES *)current;
+	
+	t->logGamma[0] = 0.0;
+	
+	for (k=1;k<t->gammaSize;k++)
+	{
+		t->logGamma[k] = LogGamma((double)k, &flag);
+	}
+	
+	for (k=0;k<t->factSize;k++)
+	{
+		t->logFact[k] = lgamma((double)k+1.0);
+	}
+	logTables.store(t, std::memory_order_release);
+}
+
+//Release the tables built by InitBetaIntegerCdf, once every call has been paired
+void FreeBetaIntegerCdf(void)
+{
+	LOG_TABLES *t, *next;
+	
+	std::lock_guard<std::mutex> lock(logTablesMutex);
+	if ((logTablesUsers==0)||(--logTablesUsers>0))
+	{
+		return;
+	}
+	
+	t = (LOG_TABLES *)logTables.load(std::memory_order_relaxed);
+	logTables.store(&emptyLogTables, std::memory_order_release);
+	for (;(t!=NULL)&&(t!=&emptyLogTables);t=next)
+	{
+		next = t->replaced;
+		free(t->logGamma);
+		free(t->logFact);
+		free(t);
+	}
+}
+
+//CDF of a central beta distribution with integer shapes a and b. Same value as BetaNoncentralCdf(a,b,0.0,x,...)
+double BetaIntegerCdf(int a, int b, double x)
+{
+	const LOG_TABLES *t = logTables.load(std::memory_order_acquire);
+	double beta_log;
+	int ifault;
+	
+	//shapes out of the table (or invalid ones) compute the normalizer directly
+	if ((a<1)||(b<1)||(a+b>=t->gammaSize))
+	{
+		beta_log = LogGamma((double)a, &ifault)
+		+ LogGamma((double)b, &ifault)
+		- LogGamma((double)(a+b), &ifault);
+	}
+	else
+	{
+		beta_log = t->logGamma[a] + t->logGamma[b] - t->logGamma[a+b];
+	}
+	
+	return betain(x, (double)a, (double)b, beta_log, &ifault);
+}
+
+//P(Bin(num,x)>=rank+1), the CDF of the (rank+1)-th smallest of num uniforms. 
+//Sums whichever binomial tail lies away from the mode, starting next to it, and stops once the terms no longer change the sum
+static double OrderStatisticTail(int rank, int num, double x)
+{
+	const double *logFact = logTables.load(std::memory_order_acquire)->logFact;   //covers num, checked by the callers
+	double logX, log1mX, ratio, term, sum;
+	int j;
+	
+	if (x<=0.0)
+	{
+		return 0.0;
+	}
+	
+	if (x>=1.0)
+	{
+		return 1.0;
+	}
+	
+	logX = log(x);
+	log1mX = log1p(-x);
+	ratio = x/(1.0-x);
+	
+	if ((num+1)*x<=rank+1)
+	{
+		//mode at or below rank+1: upper tail, terms decrease from j=rank+1
+		j = rank+1;
+		term = exp(logFact[num]-logFact[j]-logFact[num-j]+j*logX+(num-j)*log1mX);
+		sum = term;
+		
+		while (j<num)
+		{
+			term *= ratio*(num-j)/(j+1);
+			j++;
+			sum += term;
+			
+			if (term<=sum*1E-17)
+			{
+				break;
+			}
+		}
+		
+		return sum;
+	}
+	
+	//mode above rank: lower tail, terms decrease from j=rank
+	j = rank;
+	term = exp(logFact[num]-logFact[j]-logFact[num-j]+j*logX+(num-j)*log1mX);
+	sum = term;
+	
+	while (j>0)
+	{
+		term *= j/(ratio*(num-j+1));
+		j--;
+		sum += term;
+		
+		if (term<=sum*1E-17)
+		{
+			break;
+		}
+	}
+	
+	return 1.0-sum;
+}
+
+//CDF of the (rank+1)-th smallest of num uniforms at x; same value as BetaIntegerCdf(rank+1,num-rank,x)
+double OrderStatisticCdfAt(int rank, int num, double x)
+{
+	if (num>=logTables.load(std::memory_order_acquire)->factSize)
+	{
+		return BetaIntegerCdf(rank+1, num-rank, x);
+	}
+	
+	return OrderStatisticTail(rank, num, x);
+}
+
+//CDFs of the order statistics of num uniforms at ascending values x: cdf[i]=P(X_(i+1)<=x[i])=BetaIntegerCdf(i+1,num-i,x[i]), for i<rankNum
+void OrderStatisticCdf(const double *x, int num, int rankNum, double *cdf)
+{
+	int i;
+	
+	//groups larger than the table fall back to the incomplete beta function
+	if (num>=logTables.load(std::memory_order_acquire)->factSize)
+	{
+		for (i=0;i<rankNum;i++)
+		{
+			cdf[i] = BetaIntegerCdf(i+1, num-i, x[i]);
+		}
+		return;
+	}
+	
+	for (i=0;i<rankNum;i++)
+	{
+		cdf[i] = OrderStatisticTail(i, num, x[i]);
+	}
+}
+
+//log of the binomial coefficient (num choose k), from the table when it covers num
+static inline double LogChoose(int num, int k)
+{
+	const LOG_TABLES *t = logTables.load(std::memory_order_acquire);
+	
+	if (num<t->factSize)
+	{
+		return t->logFact[num]-t->logFact[k]-t->logFact[num-k];
+	}
+	
+	return lgamma(num+1.0)-lgamma(k+1.0)-lgamma(num-k+1.0);
+}
+
+//Quantile of the (rank+1)-th smallest of num uniforms: the x with OrderStatisticCdfAt(rank,num,x)=q, searched above lo.
+//Newton steps on the CDF, falling back to bisection whenever a step leaves the bracket
+double OrderStatisticQuantile(int rank, int num, double q, double lo)
+{
+	double a = lo, b = 1.0, x, fx, dens, step;
+	int iter;
+	
+	if (q<=0.0)
+	{
+		return 0.0;
+	}
+	
+	if (q>=1.0)
+	{
+		return 1.0;
+	}
+	
+	//the smallest of num uniforms has CDF 1-(1-x)^num
+	if (rank==0)
+	{
+		return -expm1(log1p(-q)/num);
+	}
+	
+	//start from the leading term of the binomial tail, C(num,rank+1)x^(rank+1)
+	x = exp((log(q)-LogChoose(num, rank+1))/(rank+1));
+	if ((x<=a)||(x>=b))
+	{
+		x = (a+b)/2;
+	}
+	
+	for (iter=0;iter<200;iter++)
+	{
+		fx = OrderStatisticCdfAt(rank, num, x)-q;
+		
+		if (fx<0)
+		{
+			a = x;
+		}
+		else
+		{
+			b = x;
+		}
+		
+		dens = exp(log((double)num)+LogChoose(num-1, rank)+rank*log(x)+(num-1-rank)*log1p(-x));
+		step = (dens>0)? fx/dens : 0.0;
+		
+		if ((dens>0)&&(x-step>a)&&(x-step<b))
+		{
+			x -= step;
+		}
+		else
+		{
+			step = x-(a+b)/2;
+			x = (a+b)/2;
+		}
+		
+		if ((fabs(step)<=1E-15*x)||(b-a<=1E-15*b))
+		{
+			break;
+		}
+	}
+	
+	return x;
+}
+
+//P(X_(i+1)<=bound[i] for some i<rankNum), over the order statistics X_(1)<=...<=X_(num) of num uniforms, for ascending bounds.
+//Bolshev-type recursion over the bounds: f[j] is the probability that exactly j uniforms lie below the current bound and no
+//order statistic has crossed yet. The mass leaving at each bound is a binomial tail, built up from one directly summed
+//tail by positive terms only, so that small probabilities keep their relative precision. work must hold 2*rankNum values
+double OrderStatisticCrossing(const double *bound, int num, int rankNum, double *work)
+{
+	double *f = work, *g = work+rankNum;
+	double prev = 0.0, crossing = 0.0, q, logQ, log1mQ, ratio, term, tail;
+	int i, j, d, fNum = 1;
+	
+	if (rankNum<=0)
+	{
+		return 0.0;
+	}
+	
+	f[0] = 1.0;
+	
+	for (i=0;i<rankNum;i++)
+	{
+		if (bound[i]>=1.0)
+		{
+			//all uniforms lie below the bound, so the (i+1)-th crosses
+			for (j=0;j<fNum;j++)
+			{
+				crossing += f[j];
+			}
+			return crossing;
+		}
+		
+		q = (bound[i]-prev)/(1.0-prev);
+		
+		if (q<=0.0)
+		{
+			//the same bound again only loosens the constraint
+			continue;
+		}
+		
+		logQ = log(q);
+		log1mQ = log1p(-q);
+		ratio = q/(1.0-q);
+		
+		for (d=0;d<=i;d++)
+		{
+			g[d] = 0.0;
+		}
+		
+		//the num-j uniforms above the previous bound fall below this one with probability q each;
+		//tail is the probability that more than i-j of them do, so the (i+1)-th order statistic crosses
+		tail = OrderStatisticCdfAt(i, num, q);
+		for (j=0;j<fNum;j++)
+		{
+			//binomial terms by their ratio, or one by one where the first term underflows
+			term = exp((num-j)*log1mQ);
+			for (d=0;j+d<=i;d++)
+			{
+				if (term<1E-280)
+				{
+					term = exp(LogChoose(num-j, d)+d*logQ+(num-j-d)*log1mQ);
+				}
+				g[j+d] += f[j]*term;
+				term *= ratio*(num-j-d)/(d+1);
+				
+				//past the mode the terms only decrease
+				if ((term<=1E-17)&&(d>=(num-j)*q))
+				{
+					break;
+				}
+			}
+			
+			crossing += f[j]*tail;
+			
+			//P(Bin(num-j-1,q)>=i-j+1) grows from P(Bin(num-j,q)>=i-j+1) by (1-q)P(Bin(num-j-1,q)=i-j)
+			if (j+1<fNum)
+			{
+				tail += exp(LogChoose(num-j-1, i-j)+(i-j)*logQ+(num-i)*log1mQ);
+			}
+		}
+		
+		for (d=0;d<=i;d++)
+		{
+			f[d] = g[d];
+		}
+		fNum = i+1;
+		prev = bound[i];
+	}
+	
+	return crossing;
+}
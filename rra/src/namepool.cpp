@@ -0,0 +1,116 @@
+/*
+ *  namepool.cpp
+ *  Interned storage of item, group and list names
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "namepool.h"
+
+//FNV-1a hash of a name
+static unsigned int HashName(const char *str, int len)
+{
+	unsigned int h = 2166136261u;
+	int i;
+	
+	for (i=0;i<len;i++){
+		h ^= (unsigned char)str[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+//Return the bucket holding the name, or the empty bucket where it should be inserted
+static unsigned int FindBucket(const NAME_POOL *pool, const char *str, int len, unsigned int h)
+{
+	unsigned int mask = pool->bucketNum-1;
+	unsigned int b = h & mask;
+	
+	while (pool->buckets[b]!=NAME_NONE){
+		const char *name = GetName(pool, pool->buckets[b]);
+		if (strncmp(name, str, len)==0 && name[len]==0){
+			break;
+		}
+		b = (b+1) & mask;
+	}
+	return b;
+}
+
+//Double the hash table and re-insert all names
+static void GrowBuckets(NAME_POOL *pool)
+{
+	unsigned int i;
+	
+	free(pool->buckets);
+	pool->bucketNum = (pool->bucketNum>0)? pool->bucketNum*2 : 1024;
+	pool->buckets = (unsigned int *)malloc(pool->bucketNum*sizeof(unsigned int));
+	memset(pool->buckets, 0xFF, pool->bucketNum*sizeof(unsigned int));
+	
+	for (i=0;i<pool->nameNum;i++){
+		const char *name = GetName(pool, i);
+		int len = strlen(name);
+		pool->buckets[FindBucket(pool, name, len, HashName(name, len))] = i;
+	}
+}
+
+//Initialize an empty pool
+void InitNamePool(NAME_POOL *pool)
+{
+	memset(pool, 0, sizeof(NAME_POOL));
+	GrowBuckets(pool);
+}
+
+//Release the memory of a pool
+void FreeNamePool(NAME_POOL *pool)
+{
+	free(pool->chars);
+	free(pool->offsets);
+	free(pool->buckets);
+	memset(pool, 0, sizeof(NAME_POOL));
+}
+
+//Return the id of a name of len bytes, adding it to the pool if it is not there yet. *isNew is set to 1 if the name was added
+unsigned int InternName(NAME_POOL *pool, const char *str, int len, int *isNew)
+{
+	unsigned int h = HashName(str, len);
+	unsigned int b = FindBucket(pool, str, len, h);
+	unsigned int id;
+	
+	if (pool->buckets[b]!=NAME_NONE){
+		*isNew = 0;
+		return pool->buckets[b];
+	}
+	
+	if (pool->charNum+len+1>pool->maxCharNum){
+		pool->maxCharNum = (pool->maxCharNum+len+1)*2;
+		pool->chars = (char *)realloc(pool->chars, pool->maxCharNum);
+	}
+	if (pool->nameNum>=pool->maxNameNum){
+		pool->maxNameNum = (pool->maxNameNum>0)? pool->maxNameNum*2 : 1024;
+		pool->offsets = (size_t *)realloc(pool->offsets, pool->maxNameNum*sizeof(size_t));
+	}
+	
+	id = pool->nameNum++;
+	pool->offsets[id] = pool->charNum;
+	memcpy(pool->chars+pool->charNum, str, len);
+	pool->chars[pool->charNum+len] = 0;
+	pool->charNum += len+1;
+	
+	//keep the hash table at most half full
+	if (2*pool->nameNum>pool->bucketNum){
+		GrowBuckets(pool);
+	}
+	else{
+		pool->buckets[b] = id;
+	}
+	
+	*isNew = 1;
+	return id;
+}
+
+//Return the id of a name of len bytes, or NAME_NONE if the name is not in the pool
+unsigned int FindName(const NAME_POOL *pool, const char *str, int len)
+{
+	return pool->buckets[FindBucket(pool, str, len, HashName(str, len))];
+}
@@ -0,0 +1,38 @@
+#ifndef NAMEPOOL_H
+#define NAMEPOOL_H
+
+#include <stddef.h>
+
+#define NAME_NONE 0xFFFFFFFFu      //returned by FindName when the name is not in the pool
+
+typedef struct // pool of interned names; every distinct name is stored once and referred to by a 32-bit id
+{
+	char *chars;                   //null-terminated names, stored back to back
+	size_t charNum;                //number of bytes used in chars
+	size_t maxCharNum;             //capacity of chars
+	size_t *offsets;               //offset of each name in chars, indexed by name id
+	unsigned int nameNum;          //number of names in the pool
+	unsigned int maxNameNum;       //capacity of offsets
+	unsigned int *buckets;         //open-addressing hash table of name ids, NAME_NONE if empty
+	unsigned int bucketNum;        //size of the hash table, always a power of 2
+} NAME_POOL;
+
+//Initialize an empty pool
+void InitNamePool(NAME_POOL *pool);
+
+//Release the memory of a pool
+void FreeNamePool(NAME_POOL *pool);
+
+//Return the id of a name of len bytes, adding it to the pool if it is not there yet. *isNew is set to 1 if the name was added
+unsigned int InternName(NAME_POOL *pool, const char *str, int len, int *isNew);
+
+//Return the id of a name of len bytes, or NAME_NONE if the name is not in the pool
+unsigned int FindName(const NAME_POOL *pool, const char *str, int len);
+
+//Return the null-terminated name of an id
+inline const char *GetName(const NAME_POOL *pool, unsigned int id)
+{
+	return pool->chars+pool->offsets[id];
+}
+
+#endif
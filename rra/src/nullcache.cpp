@@ -0,0 +1,246 @@
+//C++ functions
+#include <iostream>
+#include <mutex>
+using namespace std;
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nullcache.h"
+
+#define NULL_CACHE_MAGIC "RRANULL1"  //first 8 bytes of a cache file
+#define NULL_CACHE_MAGIC_LEN 8
+
+static std::mutex nullStoreMutex;  //protects the records of every null store
+
+//whether two keys are the same
+static inline bool SameKey(const NULL_CACHE_KEY *a, const NULL_CACHE_KEY *b)
+{
+  return a->size==b->size && a->variant==b->variant && a->maxPercentile==b->maxPercentile
+    && a->seed==b->seed && a->drawNum==b->drawNum;
+}
+
+//walk the records of a mapped cache file. If key is not NULL, return the values stored under it in *found.
+//Return the end of the last complete record; a record cut short by an interrupted append is ignored
+static size_t ScanNullCache(const char *data, size_t size, const NULL_CACHE_KEY *key, const double **found)
+{
+  size_t pos = NULL_CACHE_MAGIC_LEN;
+  NULL_CACHE_KEY recKey;
+
+  if (found!=NULL){
+    *found = NULL;
+  }
+  if (data==NULL || size<NULL_CACHE_MAGIC_LEN || memcmp(data, NULL_CACHE_MAGIC, NULL_CACHE_MAGIC_LEN)!=0){
+    return 0;
+  }
+  while (pos+sizeof(NULL_CACHE_KEY)<=size){
+    memcpy(&recKey, data+pos, sizeof(NULL_CACHE_KEY));
+    if (recKey.drawNum<0 || (size-pos-sizeof(NULL_CACHE_KEY))/sizeof(double)<(size_t)recKey.drawNum){
+      break;
+    }
+    if (key!=NULL && found!=NULL && *found==NULL && SameKey(key, &recKey)){
+      *found = (const double *)(data+pos+sizeof(NULL_CACHE_KEY));
+    }
+    pos += sizeof(NULL_CACHE_KEY)+recKey.drawNum*sizeof(double);
+  }
+  return pos;
+}
+
+//write len bytes, retrying short writes. Return 0 if success, -1 if failure
+static int WriteAll(int fd, const void *buf, size_t len)
+{
+  const char *p = (const char *)buf;
+
+  while (len>0){
+    ssize_t n = write(fd, p, len);
+    if (n<0){
+      if (errno==EINTR){
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+//Open (creating the directory and file if needed) and map the cache of a directory. Return 1 if success, -1 if failure
+int OpenNullCache(NULL_CACHE *cache, const char *dirName)
+{
+  struct stat st;
+  int fd;
+
+  cache->data = NULL;
+  cache->size = 0;
+  if (mkdir(dirName, 0777)!=0 && errno!=EEXIST){
+    cerr<<"Error: cannot create null cache directory "<<dirName<<endl;
+    return -1;
+  }
+  snprintf(cache->fileName, sizeof(cache->fileName), "%s/%s", dirName, NULL_CACHE_FILE);
+  fd = open(cache->fileName, O_RDWR|O_CREAT, 0666);
+  if (fd<0){
+    cerr<<"Error: cannot open null cache "<<cache->fileName<<endl;
+    return -1;
+  }
+  flock(fd, LOCK_SH);
+  if (fstat(fd, &st)==0 && st.st_size>0){
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p!=MAP_FAILED){
+      cache->data = (const char *)p;
+      cache->size = (size_t)st.st_size;
+    }
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+  return 1;
+}
+
+//Unmap the cache
+void CloseNullCache(NULL_CACHE *cache)
+{
+  if (cache->data!=NULL){
+    munmap((void *)cache->data, cache->size);
+  }
+  cache->data = NULL;
+  cache->size = 0;
+}
+
+//Return the sorted lo-values stored under key, pointing into the mapped file, or NULL if there are none
+const double *FindNullCache(const NULL_CACHE *cache, const NULL_CACHE_KEY *key)
+{
+  const double *found;
+
+  ScanNullCache(cache->data, cache->size, key, &found);
+  return found;
+}
+
+//Append records to the cache file under an exclusive lock; keys another process stored meanwhile are skipped.
+//The mapped view is not updated. Return 1 if success, -1 if failure
+int AppendNullCache(NULL_CACHE *cache, const NULL_CACHE_KEY *keys, const double * const *loValues, int recordNum)
+{
+  struct stat st;
+  const char *data = NULL;
+  const double *found;
+  size_t size = 0, end;
+  int fd, i, flag = 1;
+
+  fd = open(cache->fileName, O_RDWR|O_CREAT, 0666);
+  if (fd<0){
+    cerr<<"Error: cannot write null cache "<<cache->fileName<<endl;
+    return -1;
+  }
+  flock(fd, LOCK_EX);
+  if (fstat(fd, &st)==0 && st.st_size>0){
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p!=MAP_FAILED){
+      data = (const char *)p;
+      size = (size_t)st.st_size;
+    }
+  }
+
+  //drop an incomplete tail, or start a new file
+  end = ScanNullCache(data, size, NULL, NULL);
+  if (end==0){
+    if (ftruncate(fd, 0)!=0 || lseek(fd, 0, SEEK_SET)<0 || WriteAll(fd, NULL_CACHE_MAGIC, NULL_CACHE_MAGIC_LEN)!=0){
+      flag = -1;
+    }
+  }else if (ftruncate(fd, end)!=0 || lseek(fd, end, SEEK_SET)<0){
+    flag = -1;
+  }
+
+  for (i=0;i<recordNum && flag>0;i++){
+    ScanNullCache(data, size, keys+i, &found);
+    if (found!=NULL){
+      continue;
+    }
+    if (WriteAll(fd, keys+i, sizeof(NULL_CACHE_KEY))!=0 || WriteAll(fd, loValues[i], keys[i].drawNum*sizeof(double))!=0){
+      flag = -1;
+    }
+  }
+  if (flag<0){
+    cerr<<"Error: writing null cache "<<cache->fileName<<" failed."<<endl;
+  }
+
+  if (data!=NULL){
+    munmap((void *)data, size);
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+  return flag;
+}
+
+//Initialize an empty store
+void InitNullStore(NULL_STORE *store)
+{
+  store->keys = NULL;
+  store->loValues = NULL;
+  store->recordNum = 0;
+  store->maxRecordNum = 0;
+  store->byteNum = 0;
+}
+
+//Release the lo-values of a store
+void FreeNullStore(NULL_STORE *store)
+{
+  int i;
+
+  for (i=0;i<store->recordNum;i++){
+    delete []store->loValues[i];
+  }
+  free(store->keys);
+  free(store->loValues);
+  InitNullStore(store);
+}
+
+//index of the record stored under key, -1 if there is none. The caller holds nullStoreMutex
+static int FindStoreRecord(const NULL_STORE *store, const NULL_CACHE_KEY *key)
+{
+  int i;
+
+  for (i=0;i<store->recordNum;i++){
+    if (SameKey(key, store->keys+i)){
+      return i;
+    }
+  }
+  return -1;
+}
+
+//Return the sorted lo-values stored under key, or NULL if there are none
+const double *FindNullStore(NULL_STORE *store, const NULL_CACHE_KEY *key)
+{
+  std::lock_guard<std::mutex> lock(nullStoreMutex);
+  int i = FindStoreRecord(store, key);
+
+  return (i>=0)? store->loValues[i] : NULL;
+}
+
+//Copy records into the store; keys already stored, and records beyond NULL_STORE_MAX_BYTES, are skipped
+void AddNullStore(NULL_STORE *store, const NULL_CACHE_KEY *keys, const double * const *loValues, int recordNum)
+{
+  std::lock_guard<std::mutex> lock(nullStoreMutex);
+  int i;
+
+  for (i=0;i<recordNum;i++){
+    long long bytes = keys[i].drawNum*(long long)sizeof(double);
+
+    if (FindStoreRecord(store, keys+i)>=0 || store->byteNum+bytes>NULL_STORE_MAX_BYTES){
+      continue;
+    }
+    if (store->recordNum==store->maxRecordNum){
+      store->maxRecordNum = 2*store->maxRecordNum+16;
+      store->keys = (NULL_CACHE_KEY *)realloc(store->keys, store->maxRecordNum*sizeof(NULL_CACHE_KEY));
+      store->loValues = (double **)realloc(store->loValues, store->maxRecordNum*sizeof(double *));
+    }
+    store->keys[store->recordNum] = keys[i];
+    store->loValues[store->recordNum] = new double[keys[i].drawNum];
+    memcpy(store->loValues[store->recordNum], loValues[i], bytes);
+    store->byteNum += bytes;
+    store->recordNum++;
+  }
+}
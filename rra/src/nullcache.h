@@ -0,0 +1,61 @@
+#ifndef NULLCACHE_H
+#define NULLCACHE_H
+
+#include <stddef.h>
+
+#define NULL_CACHE_FILE "rra_null_cache.bin" //name of the cache file in the cache directory
+#define NULL_STORE_MAX_BYTES (1LL<<30)        //maximum size of the lo-values kept by a null store
+
+typedef struct // key of a set of null lo-values; values with the same key are identical in every run
+{
+	int size;                      //number of chosen items in the simulated groups
+	int variant;                   //lo-value method and random generator used in the simulation
+	double maxPercentile;          //percentile cutoff of the lo-values
+	long long seed;                //seed of the random simulation
+	long long drawNum;             //number of simulated lo-values
+} NULL_CACHE_KEY;
+
+typedef struct // read-only memory map of a null cache file. The file is a header followed by records, each a
+               // NULL_CACHE_KEY and its drawNum sorted lo-values. Records are only ever appended
+{
+	char fileName[1000];           //path of the cache file
+	const char *data;              //first byte of the mapped file, NULL if the file is empty
+	size_t size;                   //number of mapped bytes
+} NULL_CACHE;
+
+typedef struct // null lo-values kept in memory for the analyses of one process, e.g. the jobs of a batch. Records are
+               // only ever added, so values found stay valid until the store is freed. All functions are thread safe
+{
+	NULL_CACHE_KEY *keys;          //key of each record
+	double **loValues;             //sorted lo-values of each record
+	int recordNum;                 //number of records
+	int maxRecordNum;              //capacity of keys and loValues
+	long long byteNum;             //size of the stored lo-values
+} NULL_STORE;
+
+//Open (creating the directory and file if needed) and map the cache of a directory. Return 1 if success, -1 if failure
+int OpenNullCache(NULL_CACHE *cache, const char *dirName);
+
+//Unmap the cache
+void CloseNullCache(NULL_CACHE *cache);
+
+//Return the sorted lo-values stored under key, pointing into the mapped file, or NULL if there are none
+const double *FindNullCache(const NULL_CACHE *cache, const NULL_CACHE_KEY *key);
+
+//Append records to the cache file under an exclusive lock; keys another process stored meanwhile are skipped.
+//The mapped view is not updated. Return 1 if success, -1 if failure
+int AppendNullCache(NULL_CACHE *cache, const NULL_CACHE_KEY *keys, const double * const *loValues, int recordNum);
+
+//Initialize an empty store
+void InitNullStore(NULL_STORE *store);
+
+//Release the lo-values of a store
+void FreeNullStore(NULL_STORE *store);
+
+//Return the sorted lo-values stored under key, or NULL if there are none
+const double *FindNullStore(NULL_STORE *store, const NULL_CACHE_KEY *key);
+
+//Copy records into the store; keys already stored, and records beyond NULL_STORE_MAX_BYTES, are skipped
+void AddNullStore(NULL_STORE *store, const NULL_CACHE_KEY *keys, const double * const *loValues, int recordNum);
+
+#endif
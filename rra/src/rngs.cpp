@@ -25,6 +25,20 @@
  *                   Steve Park and Keith Miller
  *              Communications of the ACM, October 1988
  *
+ * SelectGenerator(RNG_PHILOX) switches all streams to Philox4x32-10, a
+ * counter-based generator: the n-th value of a sequence is a function
+ * of (key, n) alone, so any position is reached in O(1) time and blocks
+ * of values are computed independently of each other.  Values are
+ * multiples of 2^-32 offset by 2^-33, strictly between 0.0 and 1.0.
+ * For more details see:
+ *
+ *       "Parallel Random Numbers: As Easy as 1, 2, 3"
+ *          John Salmon, Mark Moraes, Ron Dror and David Shaw
+ *                  Proceedings of SC11, November 2011
+ *
+ * RNG_STATE holds one sequence of either generator for a single caller,
+ * so that threads can draw from separate sequences at the same time.
+ *
  * Name            : rngs.c  (Random Number Generation - Multiple Streams)
  * Authors         : Steve Park & Dave Geyer
  * Language        : ANSI C
@@ -42,10 +56,21 @@
 #define STREAMS    256        /* # of streams, DON'T CHANGE THIS VALUE    */
 #define A256       22925      /* jump multiplier, DON'T CHANGE THIS VALUE */
 #define DEFAULT    123456789  /* initial seed, use 0 < DEFAULT < MODULUS  */
+#define INDEX_JUMP 1327217885LL /* Lehmer steps between indexed sequences */
+
+#define PHILOX_M0  0xD2511F53U /* Philox4x32 multipliers                  */
+#define PHILOX_M1  0xCD9E8D57U
+#define PHILOX_W0  0x9E3779B9U /* Philox4x32 key increments (Weyl)        */
+#define PHILOX_W1  0xBB67AE85U
+#define PHILOX_ROUNDS 10
+#define PHILOX_BATCH  8        /* blocks computed side by side by RandomFill */
+#define TWO_M32    2.3283064365386963e-10 /* 2^-32                        */
       
 static long seed[STREAMS] = {DEFAULT};  /* current state of each stream   */
 static int  stream        = 0;          /* stream index, 0 is the default */
 static int  initialized   = 0;          /* test for stream initialization */
+static int  generator     = RNG_LEHMER; /* generator behind Random        */
+static RNG_STATE philox[STREAMS];       /* Philox state of each stream    */
 
 
    double Random(void)
@@ -59,6 +84,8 @@ static int  initialized   = 0;          /* test for stream initialization */
   const long R = MODULUS % MULTIPLIER;
         long t;
 
+  if (generator == RNG_PHILOX)
+    return (RandomFromState(&philox[stream]));
   t = MULTIPLIER * (seed[stream] % Q) - R * (seed[stream] / Q);
   if (t > 0) 
     seed[stream] = t;
@@ -94,6 +121,7 @@ static int  initialized   = 0;          /* test for stream initialization */
       seed[j] = x;
     else
       seed[j] = x + MODULUS;
+    InitRngState(&philox[j], RNG_PHILOX, seed[j], j, 0);
    }
 }
 
@@ -123,6 +151,7 @@ static int  initialized   = 0;          /* test for stream initialization */
         printf("\nInput out of range ... try again\n");
     }
   seed[stream] = x;
+  InitRngState(&philox[stream], RNG_PHILOX, x, stream, 0);
 }
 
 
@@ -150,6 +179,181 @@ static int  initialized   = 0;          /* test for stream initialization */
 }
 
 
+   double RandomState(long *x)
+/* ----------------------------------------------------------------
+ * Same generator as Random, but on the caller's own state x rather 
+ * than the current stream. Threads holding separate states may call 
+ * it at the same time. 
+ * ----------------------------------------------------------------
+ */
+{
+  const long Q = MODULUS / MULTIPLIER;
+  const long R = MODULUS % MULTIPLIER;
+        long t;
+
+  t = MULTIPLIER * (*x % Q) - R * (*x / Q);
+  if (t > 0) 
+    *x = t;
+  else 
+    *x = t + MODULUS;
+  return ((double) *x / MODULUS);
+}
+
+
+   long JumpSeed(long x, long long steps)
+/* ---------------------------------------------------------------------
+ * Returns the state reached from state x after 'steps' calls to Random, 
+ * i.e. x * MULTIPLIER^steps mod MODULUS, in O(log steps) time. Used to 
+ * hand consecutive pieces of one random sequence to different threads. 
+ * ---------------------------------------------------------------------
+ */
+{
+  long long a = MULTIPLIER;
+  long long y = x;
+
+  steps = steps % (MODULUS - 1);         /* the period is MODULUS - 1   */
+  while (steps > 0) {
+    if (steps & 1)
+      y = (y * a) % MODULUS;
+    a = (a * a) % MODULUS;
+    steps >>= 1;
+  }
+  return ((long) y);
+}
+
+
+   void SelectGenerator(int method)
+/* ------------------------------------------------------------------
+ * Use this function to choose the generator behind Random, RNG_LEHMER
+ * (the default) or RNG_PHILOX.  Each Philox stream starts at the
+ * beginning of the sequence keyed by the seed and index of the stream.
+ * ------------------------------------------------------------------
+ */
+{
+  int j;
+
+  generator = method;
+  for (j = 0; j < STREAMS; j++)
+    InitRngState(&philox[j], RNG_PHILOX, seed[j], j, 0);
+}
+
+
+static inline void PhiloxBlocks(const unsigned int key[2], unsigned long long counter,
+                                int num, unsigned int *out)
+/* ---------------------------------------------------------------------
+ * Philox4x32-10 blocks of counters counter..counter+num-1 (num is at
+ * most PHILOX_BATCH), 4 values each, written to out in sequence order.
+ * The blocks are kept in separate lanes so that the rounds of all of
+ * them can be computed with vector instructions.
+ * ---------------------------------------------------------------------
+ */
+{
+  unsigned int x0[PHILOX_BATCH], x1[PHILOX_BATCH], x2[PHILOX_BATCH], x3[PHILOX_BATCH];
+  unsigned int k0 = key[0], k1 = key[1];
+  unsigned long long p0, p1;
+  int i, r;
+
+  for (i = 0; i < num; i++) {
+    x0[i] = (unsigned int) (counter + i);
+    x1[i] = (unsigned int) ((counter + i) >> 32);
+    x2[i] = 0;
+    x3[i] = 0;
+  }
+  for (r = 0; r < PHILOX_ROUNDS; r++) {
+    for (i = 0; i < num; i++) {
+      p0 = (unsigned long long) PHILOX_M0 * x0[i];
+      p1 = (unsigned long long) PHILOX_M1 * x2[i];
+      x0[i] = (unsigned int) (p1 >> 32) ^ x1[i] ^ k0;
+      x2[i] = (unsigned int) (p0 >> 32) ^ x3[i] ^ k1;
+      x1[i] = (unsigned int) p1;
+      x3[i] = (unsigned int) p0;
+    }
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  for (i = 0; i < num; i++) {
+    out[4 * i]     = x0[i];
+    out[4 * i + 1] = x1[i];
+    out[4 * i + 2] = x2[i];
+    out[4 * i + 3] = x3[i];
+  }
+}
+
+
+   void InitRngState(RNG_STATE *state, int method, long x, long long index, long long offset)
+/* ---------------------------------------------------------------------
+ * Set state to the sequence 'index' of generator 'method' seeded with x,
+ * skipping its first 'offset' values.  Lehmer sequences are pieces of
+ * the one sequence from state x, INDEX_JUMP values apart, reached in
+ * O(log) time; Philox sequences are keyed by (x, index), reached in
+ * O(1) time.
+ * ---------------------------------------------------------------------
+ */
+{
+  state->method = method;
+  state->lehmer = JumpSeed(x, index * INDEX_JUMP + offset);
+  state->key[0] = (unsigned int) x;
+  state->key[1] = (unsigned int) index;
+  state->counter = (unsigned long long) offset >> 2;
+  state->used = 4;
+  if ((method == RNG_PHILOX) && (offset & 3)) {
+    PhiloxBlocks(state->key, state->counter, 1, state->block);
+    state->counter++;
+    state->used = (int) (offset & 3);
+  }
+}
+
+
+   double RandomFromState(RNG_STATE *state)
+/* ----------------------------------------------------------------
+ * Next value of the sequence held by state.
+ * ----------------------------------------------------------------
+ */
+{
+  if (state->method != RNG_PHILOX)
+    return (RandomState(&state->lehmer));
+  if (state->used == 4) {
+    PhiloxBlocks(state->key, state->counter, 1, state->block);
+    state->counter++;
+    state->used = 0;
+  }
+  return ((state->block[state->used++] + 0.5) * TWO_M32);
+}
+
+
+   void RandomFill(RNG_STATE *state, double *u, int n)
+/* ----------------------------------------------------------------
+ * Fill u with the next n values of the sequence held by state; the
+ * same values as n calls to RandomFromState.  Philox values are made
+ * PHILOX_BATCH blocks at a time.
+ * ----------------------------------------------------------------
+ */
+{
+  unsigned int out[4 * PHILOX_BATCH];
+  int i = 0, j, num;
+
+  if (state->method != RNG_PHILOX) {
+    for (i = 0; i < n; i++)
+      u[i] = RandomState(&state->lehmer);
+    return;
+  }
+  while ((i < n) && (state->used < 4))                /* rest of a block */
+    u[i++] = (state->block[state->used++] + 0.5) * TWO_M32;
+  while (n - i >= 4) {                                /* whole blocks    */
+    num = (n - i) / 4;
+    if (num > PHILOX_BATCH)
+      num = PHILOX_BATCH;
+    PhiloxBlocks(state->key, state->counter, num, out);
+    state->counter += num;
+    for (j = 0; j < 4 * num; j++)          /* signed conversion vectorizes */
+      u[i + j] = ((int) (out[j] ^ 0x80000000U) + 2147483648.5) * TWO_M32;
+    i += 4 * num;
+  }
+  while (i < n)                                       /* start of a block */
+    u[i++] = RandomFromState(state);
+}
+
+
    void TestRandom(void)
 /* ------------------------------------------------------------------
  * Use this (optional) function to test for a correct implementation.
@@ -168,10 +372,18 @@ static int  initialized   = 0;          /* test for stream initialization */
   GetSeed(&x);                      /* get the new state value   */
   ok = (x == CHECK);                /* and check for correctness */
 
-  SelectStream(1);                  /* select stream 1                 */ 
+  SelectStream(1);                  /* select stream 1                 */
   PlantSeeds(1);                    /* set the state of all streams    */
   GetSeed(&x);                      /* get the state of stream 1       */
-  ok = ok && (x == A256);           /* x should be the jump multiplier */    
+  ok = ok && (x == A256);           /* x should be the jump multiplier */
+
+  {                                 /* Philox4x32-10 known answer:     */
+    const unsigned int zero[2] = {0, 0};  /* counter 0, key 0          */
+    unsigned int block[4];
+    PhiloxBlocks(zero, 0, 1, block);
+    ok = ok && (block[0] == 0x6627e8d5U) && (block[1] == 0xe169c58dU)
+            && (block[2] == 0xbc57ac4cU) && (block[3] == 0x9b00dbd8U);
+  }
   if (ok)
     printf("\n The implementation of rngs.c is correct.\n\n");
   else
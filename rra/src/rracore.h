@@ -0,0 +1,33 @@
+#ifndef RRACORE_H
+#define RRACORE_H
+
+#include "classdef.h"
+
+//Set an analysis context to the defaults of the RRA command, without control sequences
+void InitRraContext(RRA_CONTEXT *context);
+
+//Release the control sequences of an analysis context
+void FreeRraContext(RRA_CONTEXT *context);
+
+//Rank aggregation of the groups of an item arena: percentiles, lo-values, p-values and FDRs of the groups.
+//order receives the output order of the groups. Return 1 if success, -1 if failure
+int RunRRA(RRA_CONTEXT *context, ITEM_ARENA *items, GROUP_STRUCT *groups, int groupNum, LIST_STRUCT *lists, int listNum,
+		   double maxPercentile, const NAME_POOL *itemNames, int *order);
+
+//Rank aggregation in both directions over one item arena: negative selection on the item values into negGroups, then
+//positive selection on the negated values into posGroups, which receives a copy of the group table first. The null
+//lo-values of the first direction are reused by the second when the cutoffs are equal. negOrder and posOrder receive
+//the output order of each direction; the item values are restored before returning. Return 1 if success, -1 if failure
+int RunDualTailRRA(RRA_CONTEXT *context, ITEM_ARENA *items, GROUP_STRUCT *negGroups, GROUP_STRUCT *posGroups, int groupNum,
+				   LIST_STRUCT *lists, int listNum, double negMaxPercentile, double posMaxPercentile,
+				   const NAME_POOL *itemNames, int *negOrder, int *posOrder);
+
+//Rank aggregation of every contrast of a matrix input over one item arena, group and list table. contrastGroups and
+//contrastOrder receive groupNum groups and their output order per contrast. The first contrast runs on the whole
+//worker pool; its null lo-values are then reused by the others, which are spread over the pool when there are enough
+//of them. The item arena and the tables are left unchanged. Return 1 if success, -1 if failure
+int RunMatrixRRA(RRA_CONTEXT *context, ITEM_ARENA *items, const GROUP_STRUCT *groups, int groupNum, const LIST_STRUCT *lists,
+				 int listNum, double maxPercentile, const NAME_POOL *itemNames, const CONTRAST_MATRIX *matrix,
+				 GROUP_STRUCT *contrastGroups, int *contrastOrder);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ *  threadpool.cpp
+ *  Shared worker pool for the parallel stages of RRA
+ *
+ */
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include "threadpool.h"
+
+//a loop handed to the workers: indexes are taken from next until size is reached
+struct POOL_LOOP
+{
+	const std::function<void(int,int)> *fn;   //NULL when no loop is posted
+	int size;
+	std::atomic<int> next;
+	int activeWorkers;                         //workers that took the loop and have not left it yet
+};
+
+static std::vector<std::thread> workers;
+static std::mutex poolMutex;                    //protects the loop state below
+static std::mutex callerMutex;                  //held by the caller whose loops own the pool
+static std::condition_variable startCond;
+static std::condition_variable doneCond;
+static POOL_LOOP foreground;                    //loop of ParallelFor; workers take it first
+static POOL_LOOP background;                    //loop of StartParallelFor; workers leave it when a foreground loop is posted
+static std::atomic<bool> foregroundPosted(false);   //set, under poolMutex, while a foreground loop is posted
+static bool stopping = false;
+static thread_local bool insideLoop = false;   //set on workers, and on a caller while it runs its own loop
+static thread_local bool ownsPool = false;     //set on a caller with a started loop on the pool, which holds callerMutex
+//loop of StartParallelFor, kept until FinishParallelFor; each caller thread has its own
+static thread_local std::function<void(int,int)> started;
+static thread_local int startedSize = 0;
+static thread_local bool startedOnPool = false; //whether the started loop owns the pool
+
+//whether a posted loop has indexes left; called with poolMutex held
+static bool LoopOpen(const POOL_LOOP *loop)
+{
+	return (loop->fn!=NULL)&&(loop->next.load()<loop->size);
+}
+
+//post a loop to the workers; called with poolMutex held
+static void PostLoop(POOL_LOOP *loop, const std::function<void(int,int)> *fn, int n)
+{
+	loop->fn = fn;
+	loop->size = n;
+	loop->next = 0;
+}
+
+//hand out indexes of a loop until none are left
+static void RunLoop(POOL_LOOP *loop, int threadId)
+{
+	int i;
+	
+	while ((i = loop->next.fetch_add(1))<loop->size){
+		(*loop->fn)(i, threadId);
+	}
+}
+
+//wait until the workers have left a loop whose indexes are all handed out, and remove it
+static void JoinLoop(POOL_LOOP *loop)
+{
+	std::unique_lock<std::mutex> lock(poolMutex);
+	doneCond.wait(lock, [loop]{ return loop->activeWorkers==0; });
+	loop->fn = NULL;
+}
+
+static void WorkerLoop(int threadId)
+{
+	insideLoop = true;
+	for (;;){
+		POOL_LOOP *loop;
+		{
+			std::unique_lock<std::mutex> lock(poolMutex);
+			startCond.wait(lock, []{ return stopping || LoopOpen(&foreground) || (LoopOpen(&background) && !foregroundPosted); });
+			if (stopping){
+				return;
+			}
+			loop = LoopOpen(&foreground)? &foreground : &background;
+			loop->activeWorkers++;
+		}
+		if (loop==&foreground){
+			RunLoop(loop, threadId);
+		}else{
+			//one index at a time, so that a foreground loop gets the worker back after the current index
+			int i;
+			while ((!foregroundPosted.load())&&((i = loop->next.fetch_add(1))<loop->size)){
+				(*loop->fn)(i, threadId);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(poolMutex);
+			loop->activeWorkers--;
+			if (loop->activeWorkers==0){
+				doneCond.notify_all();
+			}
+		}
+	}
+}
+
+//Start the shared worker pool. threadNum counts the calling thread; threadNum<=0 uses all available cores
+void InitThreadPool(int threadNum)
+{
+	int i;
+	
+	FreeThreadPool();
+	if (threadNum<=0){
+		threadNum = (int)std::thread::hardware_concurrency();
+	}
+	if (threadNum<1){
+		threadNum = 1;
+	}
+	stopping = false;
+	for (i=1;i<threadNum;i++){
+		workers.push_back(std::thread(WorkerLoop, i));
+	}
+}
+
+//Stop the worker threads
+void FreeThreadPool(void)
+{
+	size_t i;
+	
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		stopping = true;
+	}
+	startCond.notify_all();
+	for (i=0;i<workers.size();i++){
+		workers[i].join();
+	}
+	workers.clear();
+}
+
+//Number of threads that may run a ParallelFor, including the calling thread
+int ThreadPoolSize(void)
+{
+	return (int)workers.size()+1;
+}
+
+//Run fn(index, threadId) for every index in [0,n)
+void ParallelFor(int n, const std::function<void(int,int)> &fn)
+{
+	int i;
+	bool locked = false;
+	
+	if (n<=0){
+		return;
+	}
+	if (workers.empty() || insideLoop || n==1 || (!ownsPool && !(locked = callerMutex.try_lock()))){
+		for (i=0;i<n;i++){
+			fn(i, 0);
+		}
+		return;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		PostLoop(&foreground, &fn, n);
+		foregroundPosted = true;
+	}
+	startCond.notify_all();
+	
+	insideLoop = true;
+	RunLoop(&foreground, 0);
+	insideLoop = false;
+	
+	JoinLoop(&foreground);
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		foregroundPosted = false;
+	}
+	//workers that left a started loop go back to it
+	startCond.notify_all();
+	if (locked){
+		callerMutex.unlock();
+	}
+}
+
+//Start fn(index, threadId) for every index in [0,n) on the workers and return at once
+void StartParallelFor(int n, const std::function<void(int,int)> &fn)
+{
+	started = fn;
+	startedSize = n;
+	startedOnPool = false;
+	if (workers.empty() || insideLoop || ownsPool || n<=1 || !callerMutex.try_lock()){
+		return;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		PostLoop(&background, &started, n);
+	}
+	startedOnPool = true;
+	ownsPool = true;
+	startCond.notify_all();
+}
+
+//Join the loop of StartParallelFor
+void FinishParallelFor(void)
+{
+	int i;
+	
+	if (!startedOnPool){
+		for (i=0;i<startedSize;i++){
+			started(i, 0);
+		}
+	}else{
+		insideLoop = true;
+		RunLoop(&background, 0);
+		insideLoop = false;
+		JoinLoop(&background);
+		ownsPool = false;
+		callerMutex.unlock();
+	}
+	started = nullptr;
+	startedSize = 0;
+	startedOnPool = false;
+}
@@ -0,0 +1,30 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <functional>
+
+//Start the shared worker pool. threadNum counts the calling thread; threadNum<=0 uses all available cores
+void InitThreadPool(int threadNum);
+
+//Stop the worker threads
+void FreeThreadPool(void);
+
+//Number of threads that may run a ParallelFor, including the calling thread
+int ThreadPoolSize(void);
+
+//Run fn(index, threadId) for every index in [0,n), with threadId in [0,ThreadPoolSize()).
+//Indexes are handed out one at a time. Calls made from a worker, or while the pool is busy with another
+//caller's loop, run serially on the calling thread with threadId 0.
+void ParallelFor(int n, const std::function<void(int,int)> &fn);
+
+//Start fn(index, threadId) for every index in [0,n) on the workers and return at once, for a loop that overlaps other
+//work of the caller, with threadIds 1 and up. Until FinishParallelFor, ParallelFor calls of the caller still use the whole
+//pool: workers take them first and go back to the started loop after them, so a worker may run both loops, one at a time,
+//with the same threadId. Each calling thread may have one started loop pending; when the pool is busy, or without
+//workers, the loop runs in FinishParallelFor
+void StartParallelFor(int n, const std::function<void(int,int)> &fn);
+
+//Join the loop of StartParallelFor, running its remaining indexes on the calling thread with threadId 0
+void FinishParallelFor(void);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ *  bench_sort.cpp
+ *  Benchmark of the sort kernels on random, tie-heavy and presorted inputs, against std::sort and std::stable_sort.
+ *  Every SortIndexedArray result is also checked to be sorted and stable. Usage: bench_sort [largest size]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "math_api.h"
+#include "../src/threadpool.h"
+
+#define BENCH_REPEAT 5            //runs of each case; the fastest is reported
+
+//input patterns
+enum { PATTERN_RANDOM, PATTERN_FEW_VALUES, PATTERN_ALL_EQUAL, PATTERN_SORTED, PATTERN_REVERSED, PATTERN_NUM };
+static const char *patternNames[PATTERN_NUM] = { "random", "16 values", "all equal", "sorted", "reversed" };
+
+static void FillPattern(INDEXED_FLOAT *a, int n, int pattern)
+{
+	int i;
+	
+	srand(12345);
+	for (i=0;i<n;i++){
+		switch (pattern){
+			case PATTERN_RANDOM: a[i].value = (double)rand()/RAND_MAX; break;
+			case PATTERN_FEW_VALUES: a[i].value = rand()%16; break;
+			case PATTERN_ALL_EQUAL: a[i].value = 0.5; break;
+			case PATTERN_SORTED: a[i].value = i; break;
+			default: a[i].value = n-i; break;
+		}
+		a[i].index = i;
+	}
+}
+
+static bool LessValue(const INDEXED_FLOAT &x, const INDEXED_FLOAT &y)
+{
+	return x.value<y.value;
+}
+
+//fastest time, in ms, of sorting a fresh copy of input with sort
+template <class T, class Sort> static double TimeSort(const std::vector<T> &input, std::vector<T> &a, Sort sort)
+{
+	int r;
+	double best = 1e300;
+	
+	for (r=0;r<BENCH_REPEAT;r++){
+		a = input;
+		auto start = std::chrono::steady_clock::now();
+		sort(a.data(), (int)a.size());
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now()-start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+//whether a is sorted by value, with equal values in ascending index order
+static bool SortedStable(const std::vector<INDEXED_FLOAT> &a)
+{
+	size_t i;
+	
+	for (i=1;i<a.size();i++){
+		if ((a[i].value<a[i-1].value)||((a[i].value==a[i-1].value)&&(a[i].index<a[i-1].index))){
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, const char *argv[])
+{
+	int maxSize = (argc>1)? atoi(argv[1]) : 1000000;
+	int i, n, pattern, failNum = 0;
+	std::vector<INDEXED_FLOAT> input, a;
+	std::vector<double> plain, values;
+	
+	InitThreadPool(0);
+	printf("%d threads; fastest of %d runs, in ms\n", ThreadPoolSize(), BENCH_REPEAT);
+	printf("%-10s %-10s %12s %12s %12s %12s %8s\n", "size", "input", "SortIndexed", "stable_sort", "SortF", "std::sort", "stable");
+	for (n=1000;n<=maxSize;n*=10){
+		for (pattern=0;pattern<PATTERN_NUM;pattern++){
+			double tIndexed, tStable, tF, tStd;
+			bool stable;
+	
+			input.resize(n);
+			FillPattern(input.data(), n, pattern);
+			tIndexed = TimeSort(input, a, [](INDEXED_FLOAT *x, int m){ SortIndexedArray(x, m); });
+			stable = SortedStable(a);
+			tStable = TimeSort(input, a, [](INDEXED_FLOAT *x, int m){ std::stable_sort(x, x+m, LessValue); });
+	
+			//the same values without indexes
+			plain.resize(n);
+			for (i=0;i<n;i++){
+				plain[i] = input[i].value;
+			}
+			tF = TimeSort(plain, values, [](double *x, int m){ SortF(x, m); });
+			if (!std::is_sorted(values.begin(), values.end())){
+				stable = false;
+			}
+			tStd = TimeSort(plain, values, [](double *x, int m){ std::sort(x, x+m); });
+			
+			printf("%-10d %-10s %12.3f %12.3f %12.3f %12.3f %8s\n", n, patternNames[pattern], tIndexed, tStable, tF, tStd,
+				   stable? "yes" : "NO");
+			if (!stable){
+				failNum++;
+			}
+		}
+	}
+	FreeThreadPool();
+	
+	if (failNum>0){
+		printf("%d case(s) not sorted or not stable.\n", failNum);
+		return 1;
+	}
+	return 0;
+}
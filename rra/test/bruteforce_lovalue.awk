@@ -0,0 +1,34 @@
+# Probability-weighted lo-value of group g by brute force, for the tests of the exact computation of RRA: the lo-value of
+# every selection of the sgRNAs of g, weighted by its probability. The input has one list and the columns
+# <item id> <group id> <list id> <value> <prob>; cut is the maximum percentile. Usage: awk -v g=<group> -v cut=<p> -f ...
+# CDF of the (r+1)-th smallest of c uniforms at x: P(Binomial(c,x)>=r+1)
+function ostat(r, c, x,    j, term, s) {
+  s = 0; term = (1-x)^c
+  for (j = 0; j <= r; j++) { s += term; term = term*(c-j)/(j+1)*x/(1-x) }
+  return 1-s
+}
+NR > 1 { val[NR] = $4; grp[NR] = $2; pr[NR] = $5; n++ }
+END {
+  # percentiles, tied values sharing the average of their ranks
+  for (i in val) {
+    less = 0; eq = 0
+    for (j in val) { if (val[j] < val[i]) less++; else if (val[j] == val[i]) eq++ }
+    pct[i] = (2*less+eq)/(2*n)
+  }
+  m = 0
+  for (i in val) if (grp[i] == g) { m++; x[m] = pct[i]; p[m] = pr[i] }
+  for (i = 1; i <= m; i++) for (j = i+1; j <= m; j++) if (x[j] < x[i]) { t = x[i]; x[i] = x[j]; x[j] = t; t = p[i]; p[i] = p[j]; p[j] = t }
+  # every selection; only the ranks within the cutoff count, but the first rank always does; an empty selection scores 1
+  e = 0
+  for (s = 0; s < 2^m; s++) {
+    w = 1; c = 0; good = 0; v = s
+    for (i = 1; i <= m; i++) {
+      if (v % 2) { w *= p[i]; c++; sel[c] = x[i]; if (x[i] <= cut) good++ } else w *= 1-p[i]
+      v = int(v/2)
+    }
+    lo = 1
+    if (c > 0) { rk = (good > 0) ? good : 1; for (r = 0; r < rk; r++) { o = ostat(r, c, sel[r+1]); if (o < lo) lo = o } }
+    e += w*lo
+  }
+  printf "%.10e\n", e
+}
@@ -0,0 +1,56 @@
+#!/bin/bash
+# Regression tests of the RRA command. Usage: run_tests.sh [RRA binary]; "make test" runs them on ../bin/RRA
+RRA=${1:-$(dirname "$0")/../../bin/RRA}
+DATA=$(dirname "$0")/data
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+failNum=0
+
+# report a test: pass if the command status is 0
+check()
+{
+  if [ "$2" -eq 0 ]; then
+    echo "PASS: $1"
+  else
+    echo "FAIL: $1"
+    failNum=$((failNum+1))
+  fi
+}
+
+# a last line without a trailing newline is skipped with a warning, as by earlier versions
+"$RRA" -i "$DATA/unterminated.txt" -o "$TMP/unterminated.out" -p 0.5 > "$TMP/unterminated.log" 2>&1
+grep -q "Summary: 5 sgRNAs, 2 genes, 1 lists" "$TMP/unterminated.log" && grep -q "Warning: the last line of .* is skipped" "$TMP/unterminated.log" && \
+! grep -q "^G3" "$TMP/unterminated.out"
+check "unterminated last line" $?
+
+# a missing input file fails with the messages of earlier versions
+"$RRA" -i "$TMP/missing.txt" -o "$TMP/missing.out" > "$TMP/missing.log" 2>&1
+[ $? -ne 0 ] && grep -q "Error opening $TMP/missing.txt" "$TMP/missing.log" && grep -q "Error: incorrect input file format" "$TMP/missing.log"
+check "missing input file" $?
+
+# control sequences none of which is in the ranked list fail, rather than give an empty null
+"$RRA" -i "$DATA/unterminated.txt" -o "$TMP/nomatch.out" -p 0.5 --control "$DATA/nomatch.ctl" > "$TMP/nomatch.log" 2>&1
+[ $? -ne 0 ] && grep -q "Error: none of the control sequences is found in the ranked list" "$TMP/nomatch.log"
+check "control sequences matching no item" $?
+
+# pathway-sized groups give the same results when their lo-values are computed on several threads
+"$RRA" -i "$DATA/pathways.txt" -o "$TMP/pathways1.out" --threads 1 > "$TMP/pathways1.log" 2>&1 && \
+"$RRA" -i "$DATA/pathways.txt" -o "$TMP/pathways4.out" --threads 4 > "$TMP/pathways4.log" 2>&1 && \
+cmp -s "$TMP/pathways1.out" "$TMP/pathways4.out"
+check "pathway groups on several threads" $?
+
+# probability-weighted lo-values match the brute-force sum over all selections, within the printed precision; the groups
+# have sgRNAs within and beyond the cutoff (with ties), within it only at the top, and only beyond it
+"$RRA" -i "$DATA/weighted.txt" -o "$TMP/weighted.out" -p 0.1 > "$TMP/weighted.log" 2>&1
+status=$?
+for g in W X V; do
+  expected=$(awk -v g=$g -v cut=0.1 -f "$(dirname "$0")/bruteforce_lovalue.awk" "$DATA/weighted.txt")
+  awk -v g=$g -v e="$expected" '$1==g { found=1; d=$3-e; if (d<0) d=-d; ok=(d<=2e-4*e) } END { exit !(found && ok) }' "$TMP/weighted.out" || status=1
+done
+check "weighted lo-values against brute force" $status
+
+if [ $failNum -gt 0 ]; then
+  echo "$failNum test(s) failed."
+  exit 1
+fi
+echo "All tests passed."
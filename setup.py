@@ -18,6 +18,9 @@ def compile_rra():
   subpcall('make',shell=True);
   rev=subpcall('../bin/RRA',shell=True);
   os.chdir('../');
+  # the RRA library, loaded by mageck/rraBinding.py
+  if rev==0 and subpcall('cp bin/librra.so mageck/',shell=True)!=0:
+    print("WARNING: the RRA library is not installed; the RRA command will be used instead.",file=sys.stderr);
   return rev;
 
 
@@ -47,7 +50,7 @@ def main():
     scripts=['bin/RRA','bin/mageck'],
     package_dir={'mageck':'mageck'},
     cmdclass={'install':RRAInstall},
-    package_data={'mageck':['*.Rnw','*.RTemplate']}
+    package_data={'mageck':['*.Rnw','*.RTemplate','librra.so']}
     #package_data={'mageck':['mageck/Makefile','mageck/src/*.c','include/*','utils/*']}
     #data_files=[('',['Makefile','src/*.c','include/*','utils/*'])]
   );